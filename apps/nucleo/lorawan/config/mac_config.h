@@ -44,6 +44,12 @@ extern "C" {
 
 #define KEY_LOG_ENABLED 0
 
+/* Keep the expanded AES key schedule and CMAC subkeys of each key in RAM */
+#define SOFT_SE_KEY_CACHE_ENABLED 1
+
+/* RAM the key cache may take, in bytes; about 6.3 KB for the 23 keys of LoRaWAN 1.1 */
+#define SOFT_SE_KEY_CACHE_RAM_BUDGET 7168
+
 /* Class B ------------------------------------*/
 #define LORAMAC_CLASSB_ENABLED 1
 
@@ -82,6 +82,8 @@ extern "C"
 
 #define RADIO_MEMSET8(d, v, s) UTIL_MEM_set_8(d, v, s)
 
+#define RADIO_MEMCPY8(d, s, n) UTIL_MEM_cpy_8(d, s, n)
+
 #ifdef __cplusplus
 }
 #endif
@@ -56,10 +56,22 @@ DEALINGS WITH THE SOFTWARE
         }                                   \
     } while( 0 )
 
+#define SUBKEY( v, r )                 \
+    do                                 \
+    {                                  \
+        uint8_t msb = ( v )[0] & 0x80; \
+        LSHIFT( v, r );                \
+        if( msb )                      \
+            ( r )[15] ^= 0x87;         \
+    } while( 0 )
+
+#define CMAC_AES( ctx ) ( ( ( ctx )->key != NULL ) ? &( ctx )->key->rijndael : &( ctx )->rijndael )
+
 void AES_CMAC_Init( AES_CMAC_CTX* ctx )
 {
     memset1( ctx->X, 0, sizeof ctx->X );
     ctx->M_n = 0;
+    ctx->key = NULL;
     memset1( ctx->rijndael.ksch, '\0', 240 );
 }
 
@@ -68,6 +80,24 @@ void AES_CMAC_SetKey( AES_CMAC_CTX* ctx, const uint8_t key[AES_CMAC_KEY_LENGTH]
     lorawan_aes_set_key( key, AES_CMAC_KEY_LENGTH, &ctx->rijndael );
 }
 
+void AES_CMAC_PrepareKey( AES_CMAC_KEY* key, const uint8_t k[AES_CMAC_KEY_LENGTH] )
+{
+    lorawan_aes_set_key( k, AES_CMAC_KEY_LENGTH, &key->rijndael );
+
+    /* generate subkeys K1 and K2 */
+    memset1( key->K1, '\0', 16 );
+    lorawan_aes_encrypt( key->K1, key->K1, &key->rijndael );
+    SUBKEY( key->K1, key->K1 );
+    SUBKEY( key->K1, key->K2 );
+}
+
+void AES_CMAC_InitWithKey( AES_CMAC_CTX* ctx, const AES_CMAC_KEY* key )
+{
+    memset1( ctx->X, 0, sizeof ctx->X );
+    ctx->M_n = 0;
+    ctx->key = key;
+}
+
 void AES_CMAC_Update( AES_CMAC_CTX* ctx, const uint8_t* data, uint32_t len )
 {
     uint32_t mlen;
@@ -83,7 +113,7 @@ void AES_CMAC_Update( AES_CMAC_CTX* ctx, const uint8_t* data, uint32_t len )
         XOR( ctx->M_last, ctx->X );
 
         memcpy1( in, &ctx->X[0], 16 );  // Otherwise it does not look good
-        lorawan_aes_encrypt( in, in, &ctx->rijndael );
+        lorawan_aes_encrypt( in, in, CMAC_AES( ctx ) );
         memcpy1( &ctx->X[0], in, 16 );
 
         data += mlen;
@@ -95,7 +125,7 @@ void AES_CMAC_Update( AES_CMAC_CTX* ctx, const uint8_t* data, uint32_t len )
         XOR( data, ctx->X );
 
         memcpy1( in, &ctx->X[0], 16 );  // Otherwise it does not look good
-        lorawan_aes_encrypt( in, in, &ctx->rijndael );
+        lorawan_aes_encrypt( in, in, CMAC_AES( ctx ) );
         memcpy1( &ctx->X[0], in, 16 );
 
         data += 16;
@@ -110,18 +140,27 @@ void AES_CMAC_Final( uint8_t digest[AES_CMAC_DIGEST_LENGTH], AES_CMAC_CTX* ctx )
 {
     uint8_t K[16];
     uint8_t in[16];
-    /* generate subkey K1 */
-    memset1( K, '\0', 16 );
 
-    lorawan_aes_encrypt( K, K, &ctx->rijndael );
-
-    if( K[0] & 0x80 )
+    if( ctx->key != NULL )
     {
-        LSHIFT( K, K );
-        K[15] ^= 0x87;
+        /* subkeys were computed with the key schedule */
+        memcpy1( K, ( ctx->M_n == 16 ) ? ctx->key->K1 : ctx->key->K2, 16 );
     }
     else
-        LSHIFT( K, K );
+    {
+        /* generate subkey K1 */
+        memset1( K, '\0', 16 );
+
+        lorawan_aes_encrypt( K, K, &ctx->rijndael );
+
+        SUBKEY( K, K );
+
+        if( ctx->M_n != 16 )
+        {
+            /* generate subkey K2 */
+            SUBKEY( K, K );
+        }
+    }
 
     if( ctx->M_n == 16 )
     {
@@ -130,15 +169,6 @@ void AES_CMAC_Final( uint8_t digest[AES_CMAC_DIGEST_LENGTH], AES_CMAC_CTX* ctx )
     }
     else
     {
-        /* generate subkey K2 */
-        if( K[0] & 0x80 )
-        {
-            LSHIFT( K, K );
-            K[15] ^= 0x87;
-        }
-        else
-            LSHIFT( K, K );
-
         /* padding(M_last) */
         ctx->M_last[ctx->M_n] = 0x80;
         while( ++ctx->M_n < 16 )
@@ -149,6 +179,6 @@ void AES_CMAC_Final( uint8_t digest[AES_CMAC_DIGEST_LENGTH], AES_CMAC_CTX* ctx )
     XOR( ctx->M_last, ctx->X );
 
     memcpy1( in, &ctx->X[0], 16 );  // Otherwise it does not look good
-    lorawan_aes_encrypt( in, digest, &ctx->rijndael );
+    lorawan_aes_encrypt( in, digest, CMAC_AES( ctx ) );
     memset1( K, 0, sizeof K );
 }
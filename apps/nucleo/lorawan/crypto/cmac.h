@@ -45,8 +45,16 @@ extern "C" {
 #define AES_CMAC_KEY_LENGTH     16
 #define AES_CMAC_DIGEST_LENGTH  16
  
+/* Expanded key and K1/K2 subkeys, computed once and reused across messages */
+typedef struct _AES_CMAC_KEY {
+            lorawan_aes_context    rijndael;
+            uint8_t        K1[16];
+            uint8_t        K2[16];
+    } AES_CMAC_KEY;
+
 typedef struct _AES_CMAC_CTX {
             lorawan_aes_context    rijndael;
+            const AES_CMAC_KEY *   key;
             uint8_t        X[16];
             uint8_t        M_last[16];
             uint32_t       M_n;
@@ -57,6 +65,8 @@ typedef struct _AES_CMAC_CTX {
 //__BEGIN_DECLS
 void     AES_CMAC_Init(AES_CMAC_CTX * ctx);
 void     AES_CMAC_SetKey(AES_CMAC_CTX * ctx, const uint8_t key[AES_CMAC_KEY_LENGTH]);
+void     AES_CMAC_PrepareKey(AES_CMAC_KEY * key, const uint8_t k[AES_CMAC_KEY_LENGTH]);
+void     AES_CMAC_InitWithKey(AES_CMAC_CTX * ctx, const AES_CMAC_KEY * key);
 void     AES_CMAC_Update(AES_CMAC_CTX * ctx, const uint8_t * data, uint32_t len);
           //          __attribute__((__bounded__(__string__,2,3)));
 void     AES_CMAC_Final(uint8_t digest[AES_CMAC_DIGEST_LENGTH], AES_CMAC_CTX  * ctx);
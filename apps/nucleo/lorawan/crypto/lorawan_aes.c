@@ -64,6 +64,18 @@
 
 #include "lorawan_aes.h"
 
+/*  The byte oriented round functions are only needed by the block ciphers
+    that don't use the T-table or bitsliced encryption                    */
+#if ( defined( AES_ENC_PREKEYED ) && !defined( AES_ENC_TTABLE ) && !defined( AES_ENC_BITSLICE ) ) \
+    || defined( AES_ENC_128_OTFK ) || defined( AES_ENC_256_OTFK )
+#  define AES_ENC_BYTE_ROUNDS
+#endif
+
+#if defined( AES_ENC_BYTE_ROUNDS ) || defined( AES_DEC_PREKEYED ) \
+    || defined( AES_DEC_128_OTFK ) || defined( AES_DEC_256_OTFK )
+#  define AES_BYTE_ROUNDS
+#endif
+
 //#if defined( HAVE_UINT_32T )
 //  typedef unsigned long uint32_t;
 //#endif
@@ -191,14 +203,18 @@
     w(0xf0), w(0xf1), w(0xf2), w(0xf3), w(0xf4), w(0xf5), w(0xf6), w(0xf7),\
     w(0xf8), w(0xf9), w(0xfa), w(0xfb), w(0xfc), w(0xfd), w(0xfe), w(0xff) }
 
+#if !defined( AES_ENC_BITSLICE ) || defined( AES_BYTE_ROUNDS )
 static const uint8_t sbox[256]  =  sb_data(f1);
+#endif
 
 #if defined( AES_DEC_PREKEYED )
 static const uint8_t isbox[256] = isb_data(f1);
 #endif
 
+#if defined( AES_ENC_BYTE_ROUNDS )
 static const uint8_t gfm2_sbox[256] = sb_data(f2);
 static const uint8_t gfm3_sbox[256] = sb_data(f3);
+#endif
 
 #if defined( AES_DEC_PREKEYED )
 static const uint8_t gfmul_9[256] = mm_data(f9);
@@ -373,6 +389,8 @@ static void xor_block( void *d, const void *s )
 #endif
 }
 
+#if defined( AES_BYTE_ROUNDS )
+
 static void copy_and_key( void *d, const void *s, const void *k )
 {
 #if defined( HAVE_UINT_32T )
@@ -408,6 +426,10 @@ static void add_round_key( uint8_t d[N_BLOCK], const uint8_t k[N_BLOCK] )
     xor_block(d, k);
 }
 
+#endif
+
+#if defined( AES_ENC_BYTE_ROUNDS )
+
 static void shift_sub_rows( uint8_t st[N_BLOCK] )
 {   uint8_t tt;
 
@@ -424,6 +446,8 @@ static void shift_sub_rows( uint8_t st[N_BLOCK] )
     st[ 7] = s_box(st[ 3]); st[ 3] = s_box( tt );
 }
 
+#endif
+
 #if defined( AES_DEC_PREKEYED )
 
 static void inv_shift_sub_rows( uint8_t st[N_BLOCK] )
@@ -444,6 +468,8 @@ static void inv_shift_sub_rows( uint8_t st[N_BLOCK] )
 
 #endif
 
+#if defined( AES_ENC_BYTE_ROUNDS )
+
 #if defined( VERSION_1 )
   static void mix_sub_columns( uint8_t dt[N_BLOCK] )
   { uint8_t st[N_BLOCK];
@@ -473,6 +499,8 @@ static void inv_shift_sub_rows( uint8_t st[N_BLOCK] )
     dt[15] = gfm3_sb(st[12]) ^ s_box(st[1]) ^ s_box(st[6]) ^ gfm2_sb(st[11]);
   }
 
+#endif
+
 #if defined( AES_DEC_PREKEYED )
 
 #if defined( VERSION_1 )
@@ -506,6 +534,228 @@ static void inv_shift_sub_rows( uint8_t st[N_BLOCK] )
 
 #endif
 
+#if defined( AES_ENC_TTABLE )
+
+/*  Encryption table: the S-box output multiplied by the mix columns
+    coefficients of row 0 (2, 1, 1, 3), packed in a little endian word.
+    The tables of rows 1, 2 and 3 are byte rotations of this one.
+*/
+#define te(x)   ((uint32_t)f2(x) | ((uint32_t)(x) << 8) \
+                | ((uint32_t)(x) << 16) | ((uint32_t)f3(x) << 24))
+
+static const uint32_t t_enc[256] = sb_data(te);
+
+#define rot8(x)     (((x) << 8) | ((x) >> 24))
+#define rot16(x)    (((x) << 16) | ((x) >> 16))
+#define rot24(x)    (((x) << 24) | ((x) >> 8))
+
+#define word_in(p, c)   ((uint32_t)(p)[4 * (c)] | ((uint32_t)(p)[4 * (c) + 1] << 8) \
+                        | ((uint32_t)(p)[4 * (c) + 2] << 16) | ((uint32_t)(p)[4 * (c) + 3] << 24))
+
+#define t_round(a, b, c, d) (t_enc[(a) & 0xff] ^ rot8(t_enc[((b) >> 8) & 0xff]) \
+                            ^ rot16(t_enc[((c) >> 16) & 0xff]) ^ rot24(t_enc[(d) >> 24]))
+
+#define t_last(a, b, c, d)  ((uint32_t)s_box((a) & 0xff) | ((uint32_t)s_box(((b) >> 8) & 0xff) << 8) \
+                            | ((uint32_t)s_box(((c) >> 16) & 0xff) << 16) \
+                            | ((uint32_t)s_box((d) >> 24) << 24))
+
+static void word_out( uint8_t *p, uint32_t w )
+{
+    p[0] = (uint8_t)w;
+    p[1] = (uint8_t)(w >> 8);
+    p[2] = (uint8_t)(w >> 16);
+    p[3] = (uint8_t)(w >> 24);
+}
+
+#endif
+
+#if defined( AES_ENC_BITSLICE )
+
+/*  The state is held as 8 bit planes: bit b of byte i of the block is bit i
+    of q[b], so each plane is a 4 x 4 matrix with 4 bits per column and the
+    row index in the low bits of each nibble.
+*/
+
+/*  Transpose the 4 bytes of w so that nibble b holds bit b of each byte */
+#define bs_transpose(w) \
+    {   uint32_t t; \
+        t = ((w >> 7) ^ w) & 0x00aa00aa; w ^= t ^ (t << 7); \
+        t = ((w >> 14) ^ w) & 0x0000cccc; w ^= t ^ (t << 14); \
+    }
+
+static void bs_pack_word( uint32_t q[8], uint32_t w, uint8_t c )
+{   uint8_t b;
+
+    bs_transpose(w);
+    for( b = 0; b < 4; ++b )
+    {
+        q[b]     |= ((w >> (8 * b)) & 0x0f) << (4 * c);
+        q[b + 4] |= ((w >> (8 * b + 4)) & 0x0f) << (4 * c);
+    }
+}
+
+static uint32_t bs_unpack_word( const uint32_t q[8], uint8_t c )
+{   uint32_t w = 0;
+    uint8_t b;
+
+    for( b = 0; b < 4; ++b )
+    {
+        w |= ((q[b] >> (4 * c)) & 0x0f) << (8 * b);
+        w |= ((q[b + 4] >> (4 * c)) & 0x0f) << (8 * b + 4);
+    }
+    bs_transpose(w);
+    return w;
+}
+
+static void bs_pack( uint32_t q[8], const uint8_t in[N_BLOCK] )
+{   uint8_t c;
+
+    for( c = 0; c < 8; ++c )
+        q[c] = 0;
+    for( c = 0; c < 4; ++c, in += 4 )
+        bs_pack_word(q, (uint32_t)in[0] | ((uint32_t)in[1] << 8)
+                        | ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 24), c);
+}
+
+static void bs_unpack( uint8_t out[N_BLOCK], const uint32_t q[8] )
+{   uint8_t c;
+
+    for( c = 0; c < 4; ++c, out += 4 )
+    {   uint32_t w = bs_unpack_word(q, c);
+        out[0] = (uint8_t)w;
+        out[1] = (uint8_t)(w >> 8);
+        out[2] = (uint8_t)(w >> 16);
+        out[3] = (uint8_t)(w >> 24);
+    }
+}
+
+/*  The S-box as a boolean circuit of 113 gates (J. Boyar and R. Peralta,
+    "A new combinational logic minimization technique with applications to
+    cryptology", 2009), applied to all the bytes of the planes at once.
+*/
+static void bs_sub_bytes( uint32_t q[8] )
+{   uint32_t x0, x1, x2, x3, x4, x5, x6, x7;
+    uint32_t y1, y2, y3, y4, y5, y6, y7, y8, y9, y10, y11;
+    uint32_t y12, y13, y14, y15, y16, y17, y18, y19, y20, y21;
+    uint32_t z0, z1, z2, z3, z4, z5, z6, z7, z8;
+    uint32_t z9, z10, z11, z12, z13, z14, z15, z16, z17;
+    uint32_t t0, t1, t2, t3, t4, t5, t6, t7, t8, t9;
+    uint32_t t10, t11, t12, t13, t14, t15, t16, t17, t18, t19;
+    uint32_t t20, t21, t22, t23, t24, t25, t26, t27, t28, t29;
+    uint32_t t30, t31, t32, t33, t34, t35, t36, t37, t38, t39;
+    uint32_t t40, t41, t42, t43, t44, t45, t46, t47, t48, t49;
+    uint32_t t50, t51, t52, t53, t54, t55, t56, t57, t58, t59;
+    uint32_t t60, t61, t62, t63, t64, t65, t66, t67;
+    uint32_t s0, s1, s2, s3, s4, s5, s6, s7;
+
+    x0 = q[7]; x1 = q[6]; x2 = q[5]; x3 = q[4];
+    x4 = q[3]; x5 = q[2]; x6 = q[1]; x7 = q[0];
+
+    /* top linear transformation */
+    y14 = x3 ^ x5;  y13 = x0 ^ x6;  y9 = x0 ^ x3;   y8 = x0 ^ x5;
+    t0 = x1 ^ x2;   y1 = t0 ^ x7;   y4 = y1 ^ x3;   y12 = y13 ^ y14;
+    y2 = y1 ^ x0;   y5 = y1 ^ x6;   y3 = y5 ^ y8;   t1 = x4 ^ y12;
+    y15 = t1 ^ x5;  y20 = t1 ^ x1;  y6 = y15 ^ x7;  y10 = y15 ^ t0;
+    y11 = y20 ^ y9; y7 = x7 ^ y11;  y17 = y10 ^ y11; y19 = y10 ^ y8;
+    y16 = t0 ^ y11; y21 = y13 ^ y16; y18 = x0 ^ y16;
+
+    /* non-linear section, inversion in GF(2^8) */
+    t2 = y12 & y15; t3 = y3 & y6;   t4 = t3 ^ t2;   t5 = y4 & x7;
+    t6 = t5 ^ t2;   t7 = y13 & y16; t8 = y5 & y1;   t9 = t8 ^ t7;
+    t10 = y2 & y7;  t11 = t10 ^ t7; t12 = y9 & y11; t13 = y14 & y17;
+    t14 = t13 ^ t12; t15 = y8 & y10; t16 = t15 ^ t12; t17 = t4 ^ t14;
+    t18 = t6 ^ t16; t19 = t9 ^ t14; t20 = t11 ^ t16; t21 = t17 ^ y20;
+    t22 = t18 ^ y19; t23 = t19 ^ y21; t24 = t20 ^ y18;
+
+    t25 = t21 ^ t22; t26 = t21 & t23; t27 = t24 ^ t26; t28 = t25 & t27;
+    t29 = t28 ^ t22; t30 = t23 ^ t24; t31 = t22 ^ t26; t32 = t31 & t30;
+    t33 = t32 ^ t24; t34 = t23 ^ t33; t35 = t27 ^ t33; t36 = t24 & t35;
+    t37 = t36 ^ t34; t38 = t27 ^ t36; t39 = t29 & t38; t40 = t25 ^ t39;
+
+    t41 = t40 ^ t37; t42 = t29 ^ t33; t43 = t29 ^ t40; t44 = t33 ^ t37;
+    t45 = t42 ^ t41;
+    z0 = t44 & y15; z1 = t37 & y6;  z2 = t33 & x7;  z3 = t43 & y16;
+    z4 = t40 & y1;  z5 = t29 & y7;  z6 = t42 & y11; z7 = t45 & y17;
+    z8 = t41 & y10; z9 = t44 & y12; z10 = t37 & y3; z11 = t33 & y4;
+    z12 = t43 & y13; z13 = t40 & y5; z14 = t29 & y2; z15 = t42 & y9;
+    z16 = t45 & y14; z17 = t41 & y8;
+
+    /* bottom linear transformation */
+    t46 = z15 ^ z16; t47 = z10 ^ z11; t48 = z5 ^ z13; t49 = z9 ^ z10;
+    t50 = z2 ^ z12; t51 = z2 ^ z5;  t52 = z7 ^ z8;  t53 = z0 ^ z3;
+    t54 = z6 ^ z7;  t55 = z16 ^ z17; t56 = z12 ^ t48; t57 = t50 ^ t53;
+    t58 = z4 ^ t46; t59 = z3 ^ t54; t60 = t46 ^ t57; t61 = z14 ^ t57;
+    t62 = t52 ^ t58; t63 = t49 ^ t58; t64 = z4 ^ t59; t65 = t61 ^ t62;
+    t66 = z1 ^ t63; s0 = t59 ^ t63; s6 = t56 ^ ~t62; s7 = t48 ^ ~t60;
+    t67 = t64 ^ t65; s3 = t53 ^ t66; s4 = t51 ^ t66; s5 = t47 ^ t65;
+    s1 = t64 ^ ~s3; s2 = t55 ^ ~t67;
+
+    q[7] = s0 & 0xffff; q[6] = s1 & 0xffff; q[5] = s2 & 0xffff; q[4] = s3 & 0xffff;
+    q[3] = s4 & 0xffff; q[2] = s5 & 0xffff; q[1] = s6 & 0xffff; q[0] = s7 & 0xffff;
+}
+
+/*  Row r of each plane is rotated by r columns, i.e. by 4 * r bits */
+static void bs_shift_rows( uint32_t q[8] )
+{   uint8_t b;
+
+    for( b = 0; b < 8; ++b )
+    {   uint32_t x = q[b];
+        q[b] = ((x & 0x1111)
+             | ((x & 0x2222) >> 4) | ((x & 0x2222) << 12)
+             | ((x & 0x4444) >> 8) | ((x & 0x4444) << 8)
+             | ((x & 0x8888) >> 12) | ((x & 0x8888) << 4)) & 0xffff;
+    }
+}
+
+/*  Rotate the rows of every column by 1, 2 or 3 positions */
+#define bs_rot1(x)  ((((x) >> 1) & 0x7777) | (((x) << 3) & 0x8888))
+#define bs_rot2(x)  ((((x) >> 2) & 0x3333) | (((x) << 2) & 0xcccc))
+#define bs_rot3(x)  ((((x) >> 3) & 0x1111) | (((x) << 1) & 0xeeee))
+
+/*  a'[r] = 2 * (a[r] ^ a[r + 1]) ^ a[r + 1] ^ a[r + 2] ^ a[r + 3] */
+static void bs_mix_columns( uint32_t q[8] )
+{   uint32_t t[8];
+    uint8_t b;
+
+    for( b = 0; b < 8; ++b )
+    {   uint32_t r1 = bs_rot1(q[b]);
+        t[b] = q[b] ^ r1;
+        q[b] = r1 ^ bs_rot2(q[b]) ^ bs_rot3(q[b]);
+    }
+    q[0] ^= t[7];
+    q[1] ^= t[0] ^ t[7];
+    q[2] ^= t[1];
+    q[3] ^= t[2] ^ t[7];
+    q[4] ^= t[3] ^ t[7];
+    q[5] ^= t[4];
+    q[6] ^= t[5];
+    q[7] ^= t[6];
+}
+
+/*  The round keys are stored as bit planes, 2 bytes per plane */
+static void bs_add_round_key( uint32_t q[8], const uint8_t k[N_BLOCK] )
+{   uint8_t b;
+
+    for( b = 0; b < 8; ++b )
+        q[b] ^= (uint32_t)k[2 * b] | ((uint32_t)k[2 * b + 1] << 8);
+}
+
+/*  Substitute the 4 bytes of a key schedule word in constant time */
+static void bs_sub_word( uint8_t *t0, uint8_t *t1, uint8_t *t2, uint8_t *t3 )
+{   uint32_t q[8] = { 0 }, w;
+
+    bs_pack_word(q, (uint32_t)*t0 | ((uint32_t)*t1 << 8)
+                    | ((uint32_t)*t2 << 16) | ((uint32_t)*t3 << 24), 0);
+    bs_sub_bytes(q);
+    w = bs_unpack_word(q, 0);
+    *t0 = (uint8_t)w;
+    *t1 = (uint8_t)(w >> 8);
+    *t2 = (uint8_t)(w >> 16);
+    *t3 = (uint8_t)(w >> 24);
+}
+
+#endif
+
 #if defined( AES_ENC_PREKEYED ) || defined( AES_DEC_PREKEYED )
 
 /*  Set the cipher key for the pre-keyed version */
@@ -536,19 +786,33 @@ return_type lorawan_aes_set_key( const uint8_t key[], length_type keylen, lorawa
         t3 = ctx->ksch[cc - 1];
         if( cc % keylen == 0 )
         {
+#if defined( AES_ENC_BITSLICE )
+            tt = t0;
+            t0 = t1;
+            t1 = t2;
+            t2 = t3;
+            t3 = tt;
+            bs_sub_word( &t0, &t1, &t2, &t3 );
+            t0 ^= rc;
+#else
             tt = t0;
             t0 = s_box(t1) ^ rc;
             t1 = s_box(t2);
             t2 = s_box(t3);
             t3 = s_box(tt);
+#endif
             rc = f2(rc);
         }
         else if( keylen > 24 && cc % keylen == 16 )
         {
+#if defined( AES_ENC_BITSLICE )
+            bs_sub_word( &t0, &t1, &t2, &t3 );
+#else
             t0 = s_box(t0);
             t1 = s_box(t1);
             t2 = s_box(t2);
             t3 = s_box(t3);
+#endif
         }
         tt = cc - keylen;
         ctx->ksch[cc + 0] = ctx->ksch[tt + 0] ^ t0;
@@ -556,6 +820,20 @@ return_type lorawan_aes_set_key( const uint8_t key[], length_type keylen, lorawa
         ctx->ksch[cc + 2] = ctx->ksch[tt + 2] ^ t2;
         ctx->ksch[cc + 3] = ctx->ksch[tt + 3] ^ t3;
     }
+#if defined( AES_ENC_BITSLICE )
+    /* convert the round keys to the bit plane layout used by encrypt */
+    for( cc = 0; cc <= ctx->rnd; ++cc )
+    {   uint32_t q[8];
+        uint8_t b;
+
+        bs_pack( q, ctx->ksch + cc * N_BLOCK );
+        for( b = 0; b < 8; ++b )
+        {
+            ctx->ksch[cc * N_BLOCK + 2 * b] = (uint8_t)q[b];
+            ctx->ksch[cc * N_BLOCK + 2 * b + 1] = (uint8_t)(q[b] >> 8);
+        }
+    }
+#endif
     return 0;
 }
 
@@ -565,6 +843,75 @@ return_type lorawan_aes_set_key( const uint8_t key[], length_type keylen, lorawa
 
 /*  Encrypt a single block of 16 bytes */
 
+#if defined( AES_ENC_TTABLE )
+
+return_type lorawan_aes_encrypt( const uint8_t in[N_BLOCK], uint8_t  out[N_BLOCK], const lorawan_aes_context ctx[1] )
+{
+    if( ctx->rnd )
+    {
+        const uint8_t *k = ctx->ksch;
+        uint32_t s0, s1, s2, s3, t0, t1, t2, t3;
+        uint8_t r;
+
+        s0 = word_in(in, 0) ^ word_in(k, 0);
+        s1 = word_in(in, 1) ^ word_in(k, 1);
+        s2 = word_in(in, 2) ^ word_in(k, 2);
+        s3 = word_in(in, 3) ^ word_in(k, 3);
+
+        for( r = 1 ; r < ctx->rnd ; ++r )
+        {
+            k += N_BLOCK;
+            t0 = t_round(s0, s1, s2, s3) ^ word_in(k, 0);
+            t1 = t_round(s1, s2, s3, s0) ^ word_in(k, 1);
+            t2 = t_round(s2, s3, s0, s1) ^ word_in(k, 2);
+            t3 = t_round(s3, s0, s1, s2) ^ word_in(k, 3);
+            s0 = t0;
+            s1 = t1;
+            s2 = t2;
+            s3 = t3;
+        }
+
+        k += N_BLOCK;
+        word_out(out,      t_last(s0, s1, s2, s3) ^ word_in(k, 0));
+        word_out(out + 4,  t_last(s1, s2, s3, s0) ^ word_in(k, 1));
+        word_out(out + 8,  t_last(s2, s3, s0, s1) ^ word_in(k, 2));
+        word_out(out + 12, t_last(s3, s0, s1, s2) ^ word_in(k, 3));
+    }
+    else
+        return ( uint8_t )-1;
+    return 0;
+}
+
+#elif defined( AES_ENC_BITSLICE )
+
+return_type lorawan_aes_encrypt( const uint8_t in[N_BLOCK], uint8_t  out[N_BLOCK], const lorawan_aes_context ctx[1] )
+{
+    if( ctx->rnd )
+    {
+        uint32_t q[8];
+        uint8_t r;
+
+        bs_pack( q, in );
+        bs_add_round_key( q, ctx->ksch );
+        for( r = 1 ; r < ctx->rnd ; ++r )
+        {
+            bs_sub_bytes( q );
+            bs_shift_rows( q );
+            bs_mix_columns( q );
+            bs_add_round_key( q, ctx->ksch + r * N_BLOCK );
+        }
+        bs_sub_bytes( q );
+        bs_shift_rows( q );
+        bs_add_round_key( q, ctx->ksch + r * N_BLOCK );
+        bs_unpack( out, q );
+    }
+    else
+        return ( uint8_t )-1;
+    return 0;
+}
+
+#else
+
 return_type lorawan_aes_encrypt( const uint8_t in[N_BLOCK], uint8_t  out[N_BLOCK], const lorawan_aes_context ctx[1] )
 {
     if( ctx->rnd )
@@ -592,6 +939,8 @@ return_type lorawan_aes_encrypt( const uint8_t in[N_BLOCK], uint8_t  out[N_BLOCK
     return 0;
 }
 
+#endif
+
 /* CBC encrypt a number of blocks (input and return an IV) */
 
 return_type lorawan_aes_cbc_encrypt( const uint8_t *in, uint8_t *out,
@@ -56,6 +56,31 @@ extern "C" {
 #  define AES_DEC_256_OTFK  /* AES decryption with 'on the fly' 256 bit keying */
 #endif
 
+/*  Alternative implementations of the pre-keyed block encryption, at most
+    one may be selected. The byte oriented code below is used otherwise.
+
+    AES_ENC_TTABLE uses 32-bit column operations and a 1 kbyte lookup table,
+    it suits cores with fast 32-bit loads and a barrel shifter (Cortex-M4).
+
+    AES_ENC_BITSLICE works on bit planes of the state without any data
+    dependent table lookup or branch, it runs in constant time and needs no
+    table at all, which suits small cores with no cache (Cortex-M0+).
+*/
+#if 0
+#  define AES_ENC_TTABLE    /* AES encryption with 32-bit T-tables            */
+#endif
+#if 0
+#  define AES_ENC_BITSLICE  /* AES encryption in constant time, bitsliced     */
+#endif
+
+#if defined( AES_ENC_TTABLE ) && defined( AES_ENC_BITSLICE )
+#  error "Only one of AES_ENC_TTABLE and AES_ENC_BITSLICE can be defined"
+#endif
+
+#if defined( AES_ENC_BITSLICE ) && defined( AES_DEC_PREKEYED )
+#  error "AES_ENC_BITSLICE stores a bitsliced key schedule, AES_DEC_PREKEYED can't use it"
+#endif
+
 #define N_ROW                   4
 #define N_COL                   4
 #define N_BLOCK   (N_ROW * N_COL)
@@ -152,6 +152,25 @@ typedef struct sSecureElementNvCtx
   Key_t KeyList[NUM_OF_KEYS];
 } SecureElementNvCtx_t;
 
+#if (!defined (LORAWAN_KMS) || (LORAWAN_KMS == 0))
+#if (defined (SOFT_SE_KEY_CACHE_ENABLED) && (SOFT_SE_KEY_CACHE_ENABLED == 1))
+/*!
+ * Expanded form of a key of the key list, kept out of the NVM context
+ */
+typedef struct sKeyCache
+{
+  /*
+   * AES key schedule and CMAC subkeys
+   */
+  AES_CMAC_KEY CmacKey;
+  /*
+   * Set once CmacKey matches the key value of the same KeyList slot
+   */
+  uint8_t Valid;
+} KeyCache_t;
+#endif /* SOFT_SE_KEY_CACHE_ENABLED */
+#endif /* LORAWAN_KMS == 0 */
+
 /* Private variables ---------------------------------------------------------*/
 /*!
  * Secure element context
@@ -177,6 +196,23 @@ static const Key_t InitialKeyList[NUM_OF_KEYS] = SOFT_SE_KEY_LIST;
 
 static SecureElementNvmEvent SeNvmCtxChanged;
 
+#if (!defined (LORAWAN_KMS) || (LORAWAN_KMS == 0))
+#if (defined (SOFT_SE_KEY_CACHE_ENABLED) && (SOFT_SE_KEY_CACHE_ENABLED == 1))
+/*!
+ * Key cache, one slot per entry of SeNvmCtx.KeyList
+ */
+static KeyCache_t KeyCache[NUM_OF_KEYS];
+
+/*!
+ * RAM taken by the key cache, checked against SOFT_SE_KEY_CACHE_RAM_BUDGET
+ */
+#define KEY_CACHE_RAM_SIZE   sizeof(KeyCache)
+
+BUILD_ASSERT(KEY_CACHE_RAM_SIZE <= SOFT_SE_KEY_CACHE_RAM_BUDGET,
+             "soft-se key cache exceeds SOFT_SE_KEY_CACHE_RAM_BUDGET");
+#endif /* SOFT_SE_KEY_CACHE_ENABLED */
+#endif /* LORAWAN_KMS == 0 */
+
 #if (!defined (LORAWAN_KMS) || (LORAWAN_KMS == 0))
 #else /* LORAWAN_KMS == 1 */
 static CK_ULONG DeriveKey_template_class = CKO_SECRET_KEY;
@@ -206,6 +242,10 @@ static uint8_t tag[SE_KEY_SIZE] ALIGN(4) = {0};
 /* Private functions prototypes ---------------------------------------------------*/
 #if (!defined (LORAWAN_KMS) || (LORAWAN_KMS == 0))
 static SecureElementStatus_t GetKeyByID(KeyIdentifier_t keyID, Key_t **keyItem);
+#if (defined (SOFT_SE_KEY_CACHE_ENABLED) && (SOFT_SE_KEY_CACHE_ENABLED == 1))
+static SecureElementStatus_t GetCmacKeyByID(KeyIdentifier_t keyID, const AES_CMAC_KEY **cmacKey);
+static void InvalidateKeyCache(void);
+#endif /* SOFT_SE_KEY_CACHE_ENABLED */
 #else /* LORAWAN_KMS == 1 */
 static SecureElementStatus_t GetKeyIndexByID(KeyIdentifier_t keyID, CK_OBJECT_HANDLE *keyItem);
 #endif /* LORAWAN_KMS */
@@ -236,6 +276,41 @@ static SecureElementStatus_t GetKeyByID(KeyIdentifier_t keyID, Key_t **keyItem)
   return SECURE_ELEMENT_ERROR_INVALID_KEY_ID;
 }
 
+#if (defined (SOFT_SE_KEY_CACHE_ENABLED) && (SOFT_SE_KEY_CACHE_ENABLED == 1))
+/*
+ * Gets the expanded key from the key cache, expanding it on first use.
+ *
+ * \param[IN]  keyID          - Key identifier
+ * \param[OUT] cmacKey        - Key schedule and CMAC subkeys reference
+ * \retval                    - Status of the operation
+ */
+static SecureElementStatus_t GetCmacKeyByID(KeyIdentifier_t keyID, const AES_CMAC_KEY **cmacKey)
+{
+  for (uint8_t i = 0; i < NUM_OF_KEYS; i++)
+  {
+    if (SeNvmCtx.KeyList[i].KeyID == keyID)
+    {
+      if (KeyCache[i].Valid == 0)
+      {
+        AES_CMAC_PrepareKey(&KeyCache[i].CmacKey, SeNvmCtx.KeyList[i].KeyValue);
+        KeyCache[i].Valid = 1;
+      }
+      *cmacKey = &KeyCache[i].CmacKey;
+      return SECURE_ELEMENT_SUCCESS;
+    }
+  }
+  return SECURE_ELEMENT_ERROR_INVALID_KEY_ID;
+}
+
+/*
+ * Drops every cached key, they are expanded again on next use.
+ */
+static void InvalidateKeyCache(void)
+{
+  memset1((uint8_t *)KeyCache, 0, sizeof(KeyCache));
+}
+#endif /* SOFT_SE_KEY_CACHE_ENABLED */
+
 #else /* LORAWAN_KMS == 1 */
 
 /*
@@ -292,7 +367,13 @@ static SecureElementStatus_t ComputeCmac(uint8_t *micBxBuffer, uint8_t *buffer,
 #if (!defined (LORAWAN_KMS) || (LORAWAN_KMS == 0))
   uint8_t Cmac[16];
   AES_CMAC_CTX aesCmacCtx[1];
-
+#if (defined (SOFT_SE_KEY_CACHE_ENABLED) && (SOFT_SE_KEY_CACHE_ENABLED == 1))
+  const AES_CMAC_KEY *cmacKey;
+  retval = GetCmacKeyByID(keyID, &cmacKey);
+  if (retval == SECURE_ELEMENT_SUCCESS)
+  {
+    AES_CMAC_InitWithKey(aesCmacCtx, cmacKey);
+#else /* SOFT_SE_KEY_CACHE_ENABLED == 0 */
   AES_CMAC_Init(aesCmacCtx);
 
   Key_t *keyItem;
@@ -301,6 +382,7 @@ static SecureElementStatus_t ComputeCmac(uint8_t *micBxBuffer, uint8_t *buffer,
   if (retval == SECURE_ELEMENT_SUCCESS)
   {
     AES_CMAC_SetKey(aesCmacCtx, keyItem->KeyValue);
+#endif /* SOFT_SE_KEY_CACHE_ENABLED */
 
     if (micBxBuffer != NULL)
     {
@@ -400,6 +482,9 @@ SecureElementStatus_t SecureElementInit(SecureElementNvmEvent seNvmCtxChanged)
 
   /* Initialize LoRaWAN Key List buffer */
   memcpy1((uint8_t *)(SeNvmCtx.KeyList), (const uint8_t *)InitialKeyList, sizeof(Key_t)*NUM_OF_KEYS);
+#if (defined (SOFT_SE_KEY_CACHE_ENABLED) && (SOFT_SE_KEY_CACHE_ENABLED == 1))
+  InvalidateKeyCache();
+#endif /* SOFT_SE_KEY_CACHE_ENABLED */
 
   retval = GetKeyByID(APP_KEY, &keyItem);
   KEY_LOG(TS_OFF, VLEVEL_M, "###### OTAA ######\r\n");
@@ -530,6 +615,11 @@ SecureElementStatus_t SecureElementRestoreNvmCtx(void *seNvmCtx)
   if (seNvmCtx != 0)
   {
     memcpy1((uint8_t *) &SeNvmCtx, (uint8_t *) seNvmCtx, sizeof(SeNvmCtx));
+#if (!defined (LORAWAN_KMS) || (LORAWAN_KMS == 0))
+#if (defined (SOFT_SE_KEY_CACHE_ENABLED) && (SOFT_SE_KEY_CACHE_ENABLED == 1))
+    InvalidateKeyCache();
+#endif /* SOFT_SE_KEY_CACHE_ENABLED */
+#endif /* LORAWAN_KMS == 0 */
     return SECURE_ELEMENT_SUCCESS;
   }
   else
@@ -569,6 +659,9 @@ SecureElementStatus_t SecureElementSetKey(KeyIdentifier_t keyID, uint8_t *key)
         retval = SecureElementAesEncrypt(key, 16, MC_KE_KEY, decryptedKey);
 
         memcpy1(SeNvmCtx.KeyList[i].KeyValue, decryptedKey, SE_KEY_SIZE);
+#if (defined (SOFT_SE_KEY_CACHE_ENABLED) && (SOFT_SE_KEY_CACHE_ENABLED == 1))
+        KeyCache[i].Valid = 0;
+#endif /* SOFT_SE_KEY_CACHE_ENABLED */
         SeNvmCtxChanged();
 
         return retval;
@@ -576,6 +669,9 @@ SecureElementStatus_t SecureElementSetKey(KeyIdentifier_t keyID, uint8_t *key)
       else
       {
         memcpy1(SeNvmCtx.KeyList[i].KeyValue, key, SE_KEY_SIZE);
+#if (defined (SOFT_SE_KEY_CACHE_ENABLED) && (SOFT_SE_KEY_CACHE_ENABLED == 1))
+        KeyCache[i].Valid = 0;
+#endif /* SOFT_SE_KEY_CACHE_ENABLED */
         SeNvmCtxChanged();
         return SECURE_ELEMENT_SUCCESS;
       }
@@ -705,7 +801,15 @@ SecureElementStatus_t SecureElementAesEncrypt(uint8_t *buffer, uint16_t size, Ke
   }
 
 #if (!defined (LORAWAN_KMS) || (LORAWAN_KMS == 0))
+#if (defined (SOFT_SE_KEY_CACHE_ENABLED) && (SOFT_SE_KEY_CACHE_ENABLED == 1))
+  const AES_CMAC_KEY *cmacKey;
+  retval = GetCmacKeyByID(keyID, &cmacKey);
+  if (retval == SECURE_ELEMENT_SUCCESS)
+  {
+    const lorawan_aes_context *pAesContext = &cmacKey->rijndael;
+#else /* SOFT_SE_KEY_CACHE_ENABLED == 0 */
   lorawan_aes_context aesContext;
+  const lorawan_aes_context *pAesContext = &aesContext;
   memset1(aesContext.ksch, '\0', 240);
 
   Key_t *pItem;
@@ -714,12 +818,13 @@ SecureElementStatus_t SecureElementAesEncrypt(uint8_t *buffer, uint16_t size, Ke
   if (retval == SECURE_ELEMENT_SUCCESS)
   {
     lorawan_aes_set_key(pItem->KeyValue, 16, &aesContext);
+#endif /* SOFT_SE_KEY_CACHE_ENABLED */
 
     uint8_t block = 0;
 
     while (size != 0)
     {
-      lorawan_aes_encrypt(&buffer[block], &encBuffer[block], &aesContext);
+      lorawan_aes_encrypt(&buffer[block], &encBuffer[block], pAesContext);
       block = block + 16;
       size = size - 16;
     }
@@ -20,6 +20,12 @@
 #include <LoRaMacClassB.h>
 #include <LoRaMacTest.h>
 
+#if defined(CONFIG_NVS)
+#include <zephyr/drivers/flash.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/fs/nvs.h>
+#endif /* CONFIG_NVS */
+
 static const struct lorawan_node_config *lorawan_node_config = NULL;
 
 struct lorawan_node_runtime {
@@ -60,6 +66,93 @@ struct lorawan_node_mac_config {
 
 static struct lorawan_node_mac_config lorawan_node_mac_config = {0};
 
+struct lorawan_node_work {
+	struct k_work_q queue;
+	struct k_work process;
+	bool started;
+	/* guards the fields below, written from the radio and timer interrupts */
+	struct k_spinlock lock;
+	bool notified;
+	uint32_t notify_cycle;
+	struct lorawan_node_latency_stats stats;
+};
+
+static struct lorawan_node_work lorawan_node_work;
+
+K_THREAD_STACK_DEFINE(lorawan_node_work_stack, LORAWAN_NODE_WORKQ_STACK_SIZE);
+
+struct lorawan_node_uplink_slot {
+	bool used;
+	bool picked;
+	uint8_t port;
+	bool tx_confirmed;
+	bool aggregate;
+	uint8_t priority;
+	uint8_t size;
+	/* FIFO order inside a priority */
+	uint32_t sequence;
+	/* k_uptime_get_32() deadline, only valid when lifetime is set */
+	uint32_t expiry;
+	uint32_t lifetime;
+	uint8_t data[LORAWAN_NODE_UPLINK_MAX_SIZE];
+};
+
+struct lorawan_node_uplink_queue {
+	/* guards the slot allocation, producers may run on any thread */
+	struct k_spinlock lock;
+	uint32_t sequence;
+	struct k_work_delayable dispatch;
+	struct lorawan_node_uplink_slot slots[LORAWAN_NODE_UPLINK_SLOTS];
+	uint8_t frame[LORAWAN_NODE_UPLINK_MAX_SIZE];
+};
+
+static struct lorawan_node_uplink_queue lorawan_node_uplink;
+
+static void lorawan_node_uplink_kick(void);
+
+#if defined(CONFIG_NVS)
+/* nvs id 0 holds the layout record, ids 1..7 one LoRaMac context module each */
+#define LORAWAN_NODE_NVM_ID_LAYOUT	 0
+#define LORAWAN_NODE_NVM_ID_MODULE(module) ((uint16_t)(module) + 1)
+#define LORAWAN_NODE_NVM_MODULES	 (LORAMAC_NVMCTXMODULE_CONFIRM_QUEUE + 1)
+
+/**
+ * Frame counters, DevNonce and session keys must never roll back, so these
+ * modules are written as soon as the mac is idle. A secure-element change
+ * means a new session, which drags every other dirty module along with it.
+ */
+#define LORAWAN_NODE_NVM_URGENT_MASK                                                               \
+	(BIT(LORAMAC_NVMCTXMODULE_CRYPTO) | BIT(LORAMAC_NVMCTXMODULE_SECURE_ELEMENT))
+
+struct lorawan_node_nvm_layout {
+	uint32_t version;
+	uint32_t region;
+	uint16_t size[LORAWAN_NODE_NVM_MODULES];
+};
+
+struct lorawan_node_nvm {
+	struct nvs_fs fs;
+	bool mounted;
+	bool layout_stored;
+	/* LoRaMacNvmCtxModule_t bits, may be set from the radio and timer interrupts */
+	atomic_t dirty;
+	uint32_t flush_time;
+};
+
+static struct lorawan_node_nvm lorawan_node_nvm;
+
+/*
+ * Keys go first: after a power cut between two writes an old mac context with
+ * new keys still rejoins, whereas a joined mac context with old keys does not.
+ */
+static const LoRaMacNvmCtxModule_t lorawan_node_nvm_order[LORAWAN_NODE_NVM_MODULES] = {
+	LORAMAC_NVMCTXMODULE_SECURE_ELEMENT, LORAMAC_NVMCTXMODULE_CRYPTO,
+	LORAMAC_NVMCTXMODULE_MAC,	     LORAMAC_NVMCTXMODULE_REGION,
+	LORAMAC_NVMCTXMODULE_COMMANDS,	     LORAMAC_NVMCTXMODULE_CLASS_B,
+	LORAMAC_NVMCTXMODULE_CONFIRM_QUEUE,
+};
+#endif /* CONFIG_NVS */
+
 #if (CONFIG_LORAMAC_CLASSB_ENABLED == 1)
 static enum lorawan_node_status lorawan_node_beacon_req(void)
 {
@@ -102,6 +195,9 @@ static void lorawan_node_mcps_confirm(McpsConfirm_t *mcps_confirm)
 	if (lorawan_node_config->callbacks.data_sent) {
 		lorawan_node_config->callbacks.data_sent(&cb_params);
 	}
+
+	/* the mac is free again, send the next queued uplink */
+	lorawan_node_uplink_kick();
 }
 
 static void lorawan_node_mcps_indication(McpsIndication_t *mcps_indication)
@@ -158,6 +254,7 @@ static void lorawan_node_mlme_confirm(MlmeConfirm_t *mlme_confirm)
 		if (lorawan_node_config->callbacks.join_request) {
 			lorawan_node_config->callbacks.join_request(&cb_params);
 		}
+		lorawan_node_uplink_kick();
 	} break;
 	case MLME_LINK_CHECK: {
 		/* Check DemodMargin */
@@ -188,6 +285,7 @@ static void lorawan_node_mlme_confirm(MlmeConfirm_t *mlme_confirm)
 			/* Beacon not acquired, Request Device Time again. */
 			lorawan_node_device_time_req();
 		}
+		lorawan_node_uplink_kick();
 	} break;
 	case MLME_PING_SLOT_INFO: {
 		if (mlme_confirm->Status == LORAMAC_EVENT_INFO_STATUS_OK) {
@@ -206,6 +304,7 @@ static void lorawan_node_mlme_confirm(MlmeConfirm_t *mlme_confirm)
 		} else {
 			lorawan_node_ping_slot_req(lorawan_node_runtime.ping_periodicity);
 		}
+		lorawan_node_uplink_kick();
 	} break;
 #endif /* CONFIG_LORAMAC_CLASSB_ENABLED == 1 */
 	default:
@@ -259,18 +358,412 @@ static void lorawan_node_mlme_indication(MlmeIndication_t *mlme_indication)
 	}
 }
 
-static void lorawan_node_nvm_data_change(uint16_t notifyFlags)
+#if defined(CONFIG_NVS)
+static LoRaMacCtxs_t *lorawan_node_nvm_ctxs(void *data[], size_t size[])
+{
+	MibRequestConfirm_t mib_req;
+
+	mib_req.Type = MIB_NVM_CTXS;
+	if (LoRaMacMibGetRequestConfirm(&mib_req) != LORAMAC_STATUS_OK) {
+		return NULL;
+	}
+
+	LoRaMacCtxs_t *ctxs = mib_req.Param.Contexts;
+
+	data[LORAMAC_NVMCTXMODULE_MAC] = ctxs->MacNvmCtx;
+	size[LORAMAC_NVMCTXMODULE_MAC] = ctxs->MacNvmCtxSize;
+	data[LORAMAC_NVMCTXMODULE_REGION] = ctxs->RegionNvmCtx;
+	size[LORAMAC_NVMCTXMODULE_REGION] = ctxs->RegionNvmCtxSize;
+	data[LORAMAC_NVMCTXMODULE_CRYPTO] = ctxs->CryptoNvmCtx;
+	size[LORAMAC_NVMCTXMODULE_CRYPTO] = ctxs->CryptoNvmCtxSize;
+	data[LORAMAC_NVMCTXMODULE_SECURE_ELEMENT] = ctxs->SecureElementNvmCtx;
+	size[LORAMAC_NVMCTXMODULE_SECURE_ELEMENT] = ctxs->SecureElementNvmCtxSize;
+	data[LORAMAC_NVMCTXMODULE_COMMANDS] = ctxs->CommandsNvmCtx;
+	size[LORAMAC_NVMCTXMODULE_COMMANDS] = ctxs->CommandsNvmCtxSize;
+	data[LORAMAC_NVMCTXMODULE_CLASS_B] = ctxs->ClassBNvmCtx;
+	size[LORAMAC_NVMCTXMODULE_CLASS_B] = ctxs->ClassBNvmCtxSize;
+	data[LORAMAC_NVMCTXMODULE_CONFIRM_QUEUE] = ctxs->ConfirmQueueNvmCtx;
+	size[LORAMAC_NVMCTXMODULE_CONFIRM_QUEUE] = ctxs->ConfirmQueueNvmCtxSize;
+
+	return ctxs;
+}
+
+static void lorawan_node_nvm_layout(struct lorawan_node_nvm_layout *layout, const size_t size[])
+{
+	memset(layout, 0, sizeof(*layout));
+	layout->version = LORAWAN_NODE_NVM_VERSION;
+	layout->region = (uint32_t)lorawan_node_config->active_region;
+	for (int i = 0; i < LORAWAN_NODE_NVM_MODULES; i++) {
+		layout->size[i] = (uint16_t)size[i];
+	}
+}
+
+static bool lorawan_node_nvm_mount(void)
+{
+	struct flash_pages_info info;
+	struct nvs_fs *fs = &lorawan_node_nvm.fs;
+
+	if (lorawan_node_nvm.mounted) {
+		return true;
+	}
+
+	fs->flash_device = FLASH_AREA_DEVICE(storage);
+	if (!device_is_ready(fs->flash_device)) {
+		return false;
+	}
+
+	fs->offset = FLASH_AREA_OFFSET(storage);
+	if (flash_get_page_info_by_offs(fs->flash_device, fs->offset, &info) != 0) {
+		return false;
+	}
+
+	/* nvs only erases whole sectors, an entry can't be larger than one */
+	fs->sector_size = info.size * LORAWAN_NODE_NVM_SECTOR_PAGES;
+	fs->sector_count = FLASH_AREA_SIZE(storage) / fs->sector_size;
+	if (nvs_mount(fs) != 0) {
+		return false;
+	}
+
+	lorawan_node_nvm.mounted = true;
+	return true;
+}
+#endif /* CONFIG_NVS */
+
+static void lorawan_node_nvm_data_change(LoRaMacNvmCtxModule_t module)
 {
+#if defined(CONFIG_NVS)
+	atomic_or(&lorawan_node_nvm.dirty, BIT(module));
+#endif /* CONFIG_NVS */
 }
 
-static bool lorawan_node_nvm_ctx_store(void)
+/**
+ * Write the dirty context modules while the mac is idle, a flash erase stalls
+ * the cpu and must not land inside a receive window. The urgent modules are
+ * written at once, the others are coalesced for LORAWAN_NODE_NVM_FLUSH_INTERVAL
+ * unless @p force is set. The first store after the layout record writes every
+ * module, some of them never report a change and restore needs them all.
+ */
+static bool lorawan_node_nvm_ctx_store(bool force)
 {
+#if defined(CONFIG_NVS)
+	void *data[LORAWAN_NODE_NVM_MODULES];
+	size_t size[LORAWAN_NODE_NVM_MODULES];
+	uint32_t now = k_uptime_get_32();
+	atomic_val_t flush;
+
+	if (atomic_get(&lorawan_node_nvm.dirty) == 0 || LoRaMacIsBusy()) {
+		return false;
+	}
+
+	if (!lorawan_node_nvm_mount() || lorawan_node_nvm_ctxs(data, size) == NULL) {
+		return false;
+	}
+
+	if (!lorawan_node_nvm.layout_stored) {
+		struct lorawan_node_nvm_layout layout;
+
+		lorawan_node_nvm_layout(&layout, size);
+		if (nvs_write(&lorawan_node_nvm.fs, LORAWAN_NODE_NVM_ID_LAYOUT, &layout,
+			      sizeof(layout)) < 0) {
+			return false;
+		}
+		lorawan_node_nvm.layout_stored = true;
+		atomic_or(&lorawan_node_nvm.dirty, BIT_MASK(LORAWAN_NODE_NVM_MODULES));
+		force = true;
+	}
+
+	if (force || (atomic_get(&lorawan_node_nvm.dirty) &
+		      BIT(LORAMAC_NVMCTXMODULE_SECURE_ELEMENT)) ||
+	    (now - lorawan_node_nvm.flush_time) >= LORAWAN_NODE_NVM_FLUSH_INTERVAL) {
+		flush = atomic_clear(&lorawan_node_nvm.dirty);
+		lorawan_node_nvm.flush_time = now;
+	} else {
+		flush = atomic_and(&lorawan_node_nvm.dirty, ~LORAWAN_NODE_NVM_URGENT_MASK) &
+			LORAWAN_NODE_NVM_URGENT_MASK;
+	}
+
+	for (int i = 0; i < LORAWAN_NODE_NVM_MODULES; i++) {
+		LoRaMacNvmCtxModule_t module = lorawan_node_nvm_order[i];
+
+		if ((flush & BIT(module)) == 0) {
+			continue;
+		}
+
+		/* nvs skips the write when the data equals the last stored entry */
+		if (nvs_write(&lorawan_node_nvm.fs, LORAWAN_NODE_NVM_ID_MODULE(module),
+			      data[module], size[module]) < 0) {
+			/* keep the failed and the not yet written modules for the next call */
+			atomic_or(&lorawan_node_nvm.dirty, flush);
+			return false;
+		}
+		flush &= ~BIT(module);
+	}
+
+	return true;
+#else
 	return false;
+#endif /* CONFIG_NVS */
 }
 
 static bool lorawan_node_nvm_ctx_restore(void)
 {
+#if defined(CONFIG_NVS)
+	void *data[LORAWAN_NODE_NVM_MODULES];
+	size_t size[LORAWAN_NODE_NVM_MODULES];
+	struct lorawan_node_nvm_layout expected, stored;
+	MibRequestConfirm_t mib_req;
+	uint8_t probe;
+
+	if (!lorawan_node_nvm_mount()) {
+		return false;
+	}
+
+	mib_req.Param.Contexts = lorawan_node_nvm_ctxs(data, size);
+	if (mib_req.Param.Contexts == NULL) {
+		return false;
+	}
+
+	lorawan_node_nvm_layout(&expected, size);
+	if (nvs_read(&lorawan_node_nvm.fs, LORAWAN_NODE_NVM_ID_LAYOUT, &stored, sizeof(stored)) !=
+		    sizeof(stored) ||
+	    memcmp(&expected, &stored, sizeof(stored)) != 0) {
+		return false;
+	}
+
+	/* Check every module before touching the live contexts of the mac. */
+	for (int i = 0; i < LORAWAN_NODE_NVM_MODULES; i++) {
+		if (nvs_read(&lorawan_node_nvm.fs, LORAWAN_NODE_NVM_ID_MODULE(i), &probe,
+			     sizeof(probe)) != (ssize_t)size[i]) {
+			return false;
+		}
+	}
+
+	for (int i = 0; i < LORAWAN_NODE_NVM_MODULES; i++) {
+		if (nvs_read(&lorawan_node_nvm.fs, LORAWAN_NODE_NVM_ID_MODULE(i), data[i],
+			     size[i]) != (ssize_t)size[i]) {
+			return false;
+		}
+	}
+
+	/* The contexts now hold the stored data, let the mac re-derive its state from them. */
+	mib_req.Type = MIB_NVM_CTXS;
+	if (LoRaMacMibSetRequestConfirm(&mib_req) != LORAMAC_STATUS_OK) {
+		return false;
+	}
+
+	lorawan_node_nvm.layout_stored = true;
+	lorawan_node_nvm.flush_time = k_uptime_get_32();
+	atomic_clear(&lorawan_node_nvm.dirty);
+	return true;
+#else
 	return false;
+#endif /* CONFIG_NVS */
+}
+
+static void lorawan_node_uplink_notify(enum lorawan_node_event_status status)
+{
+	struct lorawan_node_cb_data_sent_params cb_params = {0};
+
+	cb_params.is_mcps_confirm = false;
+	cb_params.status = status;
+	if (lorawan_node_config->callbacks.data_sent) {
+		lorawan_node_config->callbacks.data_sent(&cb_params);
+	}
+}
+
+static void lorawan_node_uplink_free(struct lorawan_node_uplink_slot *slot)
+{
+	k_spinlock_key_t key = k_spin_lock(&lorawan_node_uplink.lock);
+
+	slot->used = false;
+	slot->picked = false;
+	k_spin_unlock(&lorawan_node_uplink.lock, key);
+}
+
+/* Best unpicked slot, or the best aggregation candidate for @p head of at most @p room bytes */
+static struct lorawan_node_uplink_slot *
+lorawan_node_uplink_next(const struct lorawan_node_uplink_slot *head, uint8_t room)
+{
+	struct lorawan_node_uplink_slot *best = NULL;
+
+	for (int i = 0; i < LORAWAN_NODE_UPLINK_SLOTS; i++) {
+		struct lorawan_node_uplink_slot *slot = &lorawan_node_uplink.slots[i];
+
+		if (!slot->used || slot->picked) {
+			continue;
+		}
+		if (head && (!slot->aggregate || slot->port != head->port ||
+			     slot->tx_confirmed != head->tx_confirmed || slot->size + 1 > room)) {
+			continue;
+		}
+		if (best == NULL || slot->priority < best->priority ||
+		    (slot->priority == best->priority &&
+		     (int32_t)(slot->sequence - best->sequence) < 0)) {
+			best = slot;
+		}
+	}
+	return best;
+}
+
+static void lorawan_node_uplink_handler(struct k_work *work)
+{
+	struct lorawan_node_uplink_queue *queue = &lorawan_node_uplink;
+	struct lorawan_node_uplink_slot *head, *slot;
+	uint32_t now = k_uptime_get_32();
+	LoRaMacTxInfo_t tx_info;
+	McpsReq_t mcps_req;
+	LoRaMacStatus_t status;
+	uint8_t size;
+
+	if (lorawan_node_config == NULL) {
+		return;
+	}
+
+	for (int i = 0; i < LORAWAN_NODE_UPLINK_SLOTS; i++) {
+		slot = &queue->slots[i];
+		if (slot->used && slot->lifetime && (int32_t)(now - slot->expiry) >= 0) {
+			lorawan_node_uplink_free(slot);
+			lorawan_node_uplink_notify(LORAWAN_NODE_EVENT_STATUS_TX_TIMEOUT);
+		}
+	}
+
+	/* A join, tx or Class B confirm kicks the queue again */
+	if (!lorawan_node_is_joined() || LoRaMacIsBusy() || lorawan_node_classb_pending()) {
+		return;
+	}
+
+	/* Sleep on the region band time-off rather than polling for it */
+	int32_t wait = (int32_t)(lorawan_node_runtime.duty_cycle_time - now);
+	if (wait > 0) {
+		k_work_reschedule_for_queue(&lorawan_node_work.queue, &queue->dispatch,
+					    K_MSEC(wait));
+		return;
+	}
+
+	head = lorawan_node_uplink_next(NULL, 0);
+	if (head == NULL) {
+		return;
+	}
+
+	size = head->aggregate ? head->size + 1 : head->size;
+	if (LoRaMacQueryTxPossible(size, &tx_info) != LORAMAC_STATUS_OK) {
+		if (tx_info.CurrentPossiblePayloadSize < size) {
+			/* Won't fit this datarate even without mac commands */
+			lorawan_node_uplink_free(head);
+			lorawan_node_uplink_notify(LORAWAN_NODE_EVENT_STATUS_TX_DR_PAYLOAD_SIZE_ERROR);
+			lorawan_node_uplink_kick();
+			return;
+		}
+		/* Send empty frame in order to flush MAC commands, the message stays queued */
+		mcps_req.Type = MCPS_UNCONFIRMED;
+		mcps_req.Req.Unconfirmed.Datarate = lorawan_node_config->tx_data_rate;
+		mcps_req.Req.Unconfirmed.fBuffer = NULL;
+		mcps_req.Req.Unconfirmed.fBufferSize = 0;
+		status = LoRaMacMcpsRequest(&mcps_req);
+		lorawan_node_runtime.duty_cycle_time = now + mcps_req.ReqReturn.DutyCycleWaitTime;
+		if (status == LORAMAC_STATUS_DUTYCYCLE_RESTRICTED) {
+			lorawan_node_uplink_kick();
+		} else if (status != LORAMAC_STATUS_OK && status != LORAMAC_STATUS_BUSY) {
+			/* The mac commands can't be flushed, don't stall the queue on them */
+			lorawan_node_uplink_free(head);
+			lorawan_node_uplink_notify(LORAWAN_NODE_EVENT_STATUS_ERROR);
+			lorawan_node_uplink_kick();
+		}
+		return;
+	}
+
+	head->picked = true;
+	if (head->aggregate) {
+		/* Pack the other small messages of the port into what the frame has left */
+		uint8_t room = tx_info.MaxPossibleApplicationDataSize;
+
+		size = 0;
+		for (slot = head; slot; slot = lorawan_node_uplink_next(head, room - size)) {
+			slot->picked = true;
+			queue->frame[size++] = slot->size;
+			memcpy(&queue->frame[size], slot->data, slot->size);
+			size += slot->size;
+		}
+	} else {
+		memcpy(queue->frame, head->data, head->size);
+		size = head->size;
+	}
+
+	mcps_req.Type = head->tx_confirmed ? MCPS_CONFIRMED : MCPS_UNCONFIRMED;
+	mcps_req.Req.Unconfirmed.Datarate = lorawan_node_config->tx_data_rate;
+	mcps_req.Req.Unconfirmed.fPort = head->port;
+	mcps_req.Req.Unconfirmed.fBufferSize = size;
+	mcps_req.Req.Unconfirmed.fBuffer = queue->frame;
+	status = LoRaMacMcpsRequest(&mcps_req);
+	lorawan_node_runtime.duty_cycle_time = now + mcps_req.ReqReturn.DutyCycleWaitTime;
+
+	for (int i = 0; i < LORAWAN_NODE_UPLINK_SLOTS; i++) {
+		slot = &queue->slots[i];
+		if (!slot->picked) {
+			continue;
+		}
+		if (status == LORAMAC_STATUS_OK) {
+			lorawan_node_uplink_free(slot);
+		} else {
+			slot->picked = false;
+		}
+	}
+
+	if (status == LORAMAC_STATUS_DUTYCYCLE_RESTRICTED) {
+		/* duty_cycle_time now holds the band time-off */
+		lorawan_node_uplink_kick();
+	} else if (status != LORAMAC_STATUS_OK && status != LORAMAC_STATUS_BUSY) {
+		lorawan_node_uplink_free(head);
+		lorawan_node_uplink_notify(LORAWAN_NODE_EVENT_STATUS_ERROR);
+		lorawan_node_uplink_kick();
+	}
+}
+
+static void lorawan_node_uplink_kick(void)
+{
+	if (lorawan_node_work.started) {
+		k_work_reschedule_for_queue(&lorawan_node_work.queue, &lorawan_node_uplink.dispatch,
+					    K_NO_WAIT);
+	}
+}
+
+static void lorawan_node_mac_process_notify(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&lorawan_node_work.lock);
+
+	/* the latency counts from the oldest event not yet processed */
+	if (!lorawan_node_work.notified) {
+		lorawan_node_work.notified = true;
+		lorawan_node_work.notify_cycle = k_cycle_get_32();
+	}
+	k_spin_unlock(&lorawan_node_work.lock, key);
+
+	k_work_submit_to_queue(&lorawan_node_work.queue, &lorawan_node_work.process);
+
+	if (lorawan_node_config && lorawan_node_config->callbacks.mac_process) {
+		lorawan_node_config->callbacks.mac_process();
+	}
+}
+
+static void lorawan_node_process_handler(struct k_work *work)
+{
+	struct lorawan_node_latency_stats *stats = &lorawan_node_work.stats;
+	k_spinlock_key_t key = k_spin_lock(&lorawan_node_work.lock);
+
+	if (lorawan_node_work.notified) {
+		uint32_t us = k_cyc_to_us_floor32(k_cycle_get_32() -
+						  lorawan_node_work.notify_cycle);
+		int bucket = (us == 0) ? 0 : 31 - __builtin_clz(us);
+
+		lorawan_node_work.notified = false;
+		stats->count++;
+		stats->max_us = MAX(stats->max_us, us);
+		stats->buckets[MIN(bucket, LORAWAN_NODE_LATENCY_BUCKETS - 1)]++;
+	}
+	k_spin_unlock(&lorawan_node_work.lock, key);
+
+	LoRaMacProcess();
+	lorawan_node_nvm_ctx_store(false);
 }
 
 enum lorawan_node_status lorawan_node_init(const struct lorawan_node_config *config)
@@ -293,10 +786,23 @@ enum lorawan_node_status lorawan_node_init(const struct lorawan_node_config *con
 	lorawan_node_mac_config.primitives.MacMcpsIndication = lorawan_node_mcps_indication;
 	lorawan_node_mac_config.primitives.MacMlmeConfirm = lorawan_node_mlme_confirm;
 	lorawan_node_mac_config.primitives.MacMlmeIndication = lorawan_node_mlme_indication;
-	lorawan_node_mac_config.callbacks.NvmDataChange = lorawan_node_nvm_data_change;
+	lorawan_node_mac_config.callbacks.NvmContextChange = lorawan_node_nvm_data_change;
 	lorawan_node_mac_config.callbacks.GetBatteryLevel = config->callbacks.get_battery_level;
 	lorawan_node_mac_config.callbacks.GetTemperatureLevel = config->callbacks.get_temperature;
-	lorawan_node_mac_config.callbacks.MacProcessNotify = config->callbacks.mac_process;
+	lorawan_node_mac_config.callbacks.MacProcessNotify = lorawan_node_mac_process_notify;
+
+	/**
+	 * Start the work queue the mac events and callbacks run on
+	 */
+	if (!lorawan_node_work.started) {
+		k_work_init(&lorawan_node_work.process, lorawan_node_process_handler);
+		k_work_queue_start(&lorawan_node_work.queue, lorawan_node_work_stack,
+				   K_THREAD_STACK_SIZEOF(lorawan_node_work_stack),
+				   LORAWAN_NODE_WORKQ_PRIORITY, NULL);
+		k_thread_name_set(&lorawan_node_work.queue.thread, "lorawan_node");
+		k_work_init_delayable(&lorawan_node_uplink.dispatch, lorawan_node_uplink_handler);
+		lorawan_node_work.started = true;
+	}
 
 	/**
 	 * Initial runtime data
@@ -369,20 +875,26 @@ enum lorawan_node_status lorawan_node_init(const struct lorawan_node_config *con
 	MibRequestConfirm_t mib_req;
 	if (lorawan_node_nvm_ctx_restore()) {
 		lorawan_node_runtime.ctx_restore_done = true;
-	} else {
-		lorawan_node_runtime.ctx_restore_done = false;
-		/* Read secure-element DEV_EUI and JOIN_EUI values. */
-		mib_req.Type = MIB_DEV_EUI;
-		status = LoRaMacMibGetRequestConfirm(&mib_req);
-		assert(status == LORAMAC_STATUS_OK);
-		memcpy(lorawan_node_runtime.device_eui, mib_req.Param.DevEui, 8);
 
-		mib_req.Type = MIB_JOIN_EUI;
+		mib_req.Type = MIB_DEV_ADDR;
 		status = LoRaMacMibGetRequestConfirm(&mib_req);
 		assert(status == LORAMAC_STATUS_OK);
-		memcpy(lorawan_node_runtime.join_eui, mib_req.Param.JoinEui, 8);
+		lorawan_node_runtime.device_address = mib_req.Param.DevAddr;
+	} else {
+		lorawan_node_runtime.ctx_restore_done = false;
 	}
 
+	/* Read secure-element DEV_EUI and JOIN_EUI values. */
+	mib_req.Type = MIB_DEV_EUI;
+	status = LoRaMacMibGetRequestConfirm(&mib_req);
+	assert(status == LORAMAC_STATUS_OK);
+	memcpy(lorawan_node_runtime.device_eui, mib_req.Param.DevEui, 8);
+
+	mib_req.Type = MIB_JOIN_EUI;
+	status = LoRaMacMibGetRequestConfirm(&mib_req);
+	assert(status == LORAMAC_STATUS_OK);
+	memcpy(lorawan_node_runtime.join_eui, mib_req.Param.JoinEui, 8);
+
 	mib_req.Type = MIB_PUBLIC_NETWORK;
 	mib_req.Param.EnablePublicNetwork = config->public_network;
 	status = LoRaMacMibSetRequestConfirm(&mib_req);
@@ -429,6 +941,20 @@ enum lorawan_node_status lorawan_node_join(const struct lorawan_node_join_config
 		status = LoRaMacStart();
 		assert(status == LORAMAC_STATUS_OK);
 
+		if (lorawan_node_runtime.ctx_restore_done && lorawan_node_is_joined()) {
+			/* The restored session is still valid, no need to join again. */
+			struct lorawan_node_cb_join_request_params cb_params;
+
+			cb_params.mode = LORAWAN_NODE_ACTIVATION_OTAA;
+			cb_params.status = LORAWAN_NODE_EVENT_STATUS_OK;
+			lorawan_node_get_tx_data_rate(&cb_params.data_rate);
+			if (lorawan_node_config->callbacks.join_request) {
+				lorawan_node_config->callbacks.join_request(&cb_params);
+			}
+			lorawan_node_uplink_kick();
+			return LORAWAN_NODE_STATUS_OK;
+		}
+
 		mib_req.Type = MIB_DEV_EUI;
 		mib_req.Param.DevEui = join_cfg->dev_eui;
 		status = LoRaMacMibSetRequestConfirm(&mib_req);
@@ -496,6 +1022,46 @@ enum lorawan_node_status lorawan_node_join(const struct lorawan_node_join_config
 	}
 }
 
+enum lorawan_node_status lorawan_node_send_queued(const struct lorawan_node_send_params *params,
+						  const void *data, uint8_t size)
+{
+	struct lorawan_node_uplink_slot *slot = NULL;
+	k_spinlock_key_t key;
+
+	if (size > LORAWAN_NODE_UPLINK_MAX_SIZE ||
+	    (params->aggregate && size > LORAWAN_NODE_UPLINK_MAX_SIZE - 1)) {
+		return LORAWAN_NODE_STATUS_PARAMETER_INVALID;
+	}
+
+	key = k_spin_lock(&lorawan_node_uplink.lock);
+	for (int i = 0; i < LORAWAN_NODE_UPLINK_SLOTS; i++) {
+		if (!lorawan_node_uplink.slots[i].used) {
+			slot = &lorawan_node_uplink.slots[i];
+			break;
+		}
+	}
+	if (slot == NULL) {
+		k_spin_unlock(&lorawan_node_uplink.lock, key);
+		return LORAWAN_NODE_STATUS_BUSY;
+	}
+
+	slot->port = params->port;
+	slot->tx_confirmed = params->tx_confirmed;
+	slot->aggregate = params->aggregate;
+	slot->priority = params->priority;
+	slot->lifetime = params->lifetime;
+	slot->expiry = k_uptime_get_32() + params->lifetime;
+	slot->sequence = lorawan_node_uplink.sequence++;
+	slot->size = size;
+	memcpy(slot->data, data, size);
+	slot->picked = false;
+	slot->used = true;
+	k_spin_unlock(&lorawan_node_uplink.lock, key);
+
+	lorawan_node_uplink_kick();
+	return LORAWAN_NODE_STATUS_OK;
+}
+
 enum lorawan_node_status lorawan_node_send(uint8_t port, const void *data, uint8_t size,
 					   bool tx_confirmed)
 {
@@ -587,9 +1153,15 @@ enum lorawan_node_status lorawan_node_request_class(enum lorawan_node_class new_
 				return LORAWAN_NODE_STATUS_PARAMETER_INVALID;
 			} else {
 				/* Beacon must first be acquired */
-				lorawan_node_runtime.classb_pending = true;
+				enum lorawan_node_status ret;
 
-				return lorawan_node_beacon_req();
+				lorawan_node_runtime.classb_pending = true;
+				ret = lorawan_node_beacon_req();
+				if (ret != LORAWAN_NODE_STATUS_OK) {
+					/* No switch in progress, don't hold the uplink queue */
+					lorawan_node_runtime.classb_pending = false;
+				}
+				return ret;
 			}
 #else  /* CONFIG_LORAMAC_CLASSB_ENABLED == 0 */
 			return LORAWAN_NODE_STATUS_PARAMETER_INVALID;
@@ -623,8 +1195,42 @@ enum lorawan_node_status lorawan_node_request_class(enum lorawan_node_class new_
 void lorawan_node_process(void)
 {
 	assert(lorawan_node_config);
-	LoRaMacProcess();
-	lorawan_node_nvm_ctx_store();
+	k_work_submit_to_queue(&lorawan_node_work.queue, &lorawan_node_work.process);
+}
+
+enum lorawan_node_status lorawan_node_submit(struct k_work *work)
+{
+	if (!lorawan_node_work.started) {
+		return LORAWAN_NODE_STATUS_ERROR;
+	}
+
+	if (k_work_submit_to_queue(&lorawan_node_work.queue, work) < 0) {
+		return LORAWAN_NODE_STATUS_BUSY;
+	}
+	return LORAWAN_NODE_STATUS_OK;
+}
+
+enum lorawan_node_status lorawan_node_schedule(struct k_work_delayable *work, k_timeout_t delay)
+{
+	if (!lorawan_node_work.started) {
+		return LORAWAN_NODE_STATUS_ERROR;
+	}
+
+	if (k_work_reschedule_for_queue(&lorawan_node_work.queue, work, delay) < 0) {
+		return LORAWAN_NODE_STATUS_BUSY;
+	}
+	return LORAWAN_NODE_STATUS_OK;
+}
+
+void lorawan_node_get_latency_stats(struct lorawan_node_latency_stats *stats, bool reset)
+{
+	k_spinlock_key_t key = k_spin_lock(&lorawan_node_work.lock);
+
+	*stats = lorawan_node_work.stats;
+	if (reset) {
+		memset(&lorawan_node_work.stats, 0, sizeof(lorawan_node_work.stats));
+	}
+	k_spin_unlock(&lorawan_node_work.lock, key);
 }
 
 enum lorawan_node_status lorawan_node_device_time_req(void)
@@ -645,6 +1251,9 @@ enum lorawan_node_status lorawan_node_stop(void)
 {
 	assert(lorawan_node_config);
 
+	/* Don't lose the coalesced contexts on a planned stop. */
+	lorawan_node_nvm_ctx_store(true);
+
 	LoRaMacStatus_t status = LoRaMacDeInitialization();
 
 	if (status == LORAMAC_STATUS_OK) {
@@ -18,10 +18,44 @@ extern "C" {
 #include <stdbool.h>
 #include <stdint.h>
 
+struct k_work;
+
 #ifndef LORAWAN_NODE_ABP_VERSION
 #define LORAWAN_NODE_ABP_VERSION  0x01000300 /* 1.0.3.0 */
 #endif
 
+#ifndef LORAWAN_NODE_WORKQ_STACK_SIZE
+#define LORAWAN_NODE_WORKQ_STACK_SIZE  2048
+#endif
+
+#ifndef LORAWAN_NODE_WORKQ_PRIORITY
+#define LORAWAN_NODE_WORKQ_PRIORITY  (-2) /* cooperative, above every application thread */
+#endif
+
+#ifndef LORAWAN_NODE_LATENCY_BUCKETS
+#define LORAWAN_NODE_LATENCY_BUCKETS  16 /* log2 microsecond buckets */
+#endif
+
+#ifndef LORAWAN_NODE_UPLINK_SLOTS
+#define LORAWAN_NODE_UPLINK_SLOTS  8 /* messages waiting in the uplink queue */
+#endif
+
+#ifndef LORAWAN_NODE_UPLINK_MAX_SIZE
+#define LORAWAN_NODE_UPLINK_MAX_SIZE  242 /* largest FRMPayload of any region */
+#endif
+
+#ifndef LORAWAN_NODE_NVM_VERSION
+#define LORAWAN_NODE_NVM_VERSION  1 /* bump when a stored context layout changes */
+#endif
+
+#ifndef LORAWAN_NODE_NVM_FLUSH_INTERVAL
+#define LORAWAN_NODE_NVM_FLUSH_INTERVAL  (60 * 60 * 1000) /* ms, non-urgent context writes */
+#endif
+
+#ifndef LORAWAN_NODE_NVM_SECTOR_PAGES
+#define LORAWAN_NODE_NVM_SECTOR_PAGES  2 /* flash pages per nvs sector */
+#endif
+
 enum lorawan_node_region {
 	/**
 	 * AS band on 923MHz
@@ -293,12 +327,14 @@ struct lorawan_node_callbacks {
 	uint8_t (*get_battery_level)(void);
 	/**
 	 * @brief Get the current temperature
-	 * @retval value  Temperature in degree Celsius
+	 * @retval value  Temperature in degree Celsius, two's complement
+	 *                when below zero
 	 */
-	float (*get_temperature)(void);
+	uint16_t (*get_temperature)(void);
 	/**
 	 * @brief    Will be called each time a Radio IRQ is handled by the MAC
-	 *          layer.
+	 *          layer. Optional, the node already schedules the processing
+	 *          on its own work queue.
 	 * @warning  Runs in a IRQ context. Should only change variables state.
 	 */
 	void (*mac_process)(void);
@@ -423,11 +459,76 @@ enum lorawan_node_status lorawan_node_init(const struct lorawan_node_config *con
 enum lorawan_node_status lorawan_node_join(const struct lorawan_node_join_config *join_cfg);
 
 /**
- * @brief Processes the LoRaMac and Radio events. When no pendig operation asks to go in low power mode.
- * @remark This function must be called in the main loop.
+ * @brief Schedules the processing of the LoRaMac and Radio events.
+ * @remark Radio and MAC timer events schedule it by themselves, the processing
+ *         and every callback run on the lorawan_node work queue.
  */
 void lorawan_node_process(void);
 
+/**
+ * @brief Runs an application work item on the lorawan_node work queue.
+ * @remark LoRaMac isn't reentrant, requests made outside of the callbacks
+ *         should be submitted here to be serialized with the event processing.
+ * @param [in] work work item to submit
+ * @retval LORAWAN_NODE_STATUS_OK: success, otherwise failed.
+ */
+enum lorawan_node_status lorawan_node_submit(struct k_work *work);
+
+/**
+ * @brief Runs an application work item on the lorawan_node work queue after a delay.
+ * @remark A pending item is moved to the new deadline.
+ * @param [in] work work item to schedule
+ * @param [in] delay time to wait before running it
+ * @retval LORAWAN_NODE_STATUS_OK: success, otherwise failed.
+ */
+enum lorawan_node_status lorawan_node_schedule(struct k_work_delayable *work, k_timeout_t delay);
+
+struct lorawan_node_latency_stats {
+	/* Number of dispatched events */
+	uint32_t count;
+	/* Worst event to work queue dispatch latency in microseconds */
+	uint32_t max_us;
+	/* buckets[i] counts latencies in [2^i, 2^(i+1)) us, the last one is open ended */
+	uint32_t buckets[LORAWAN_NODE_LATENCY_BUCKETS];
+};
+
+/**
+ * @brief Gets the dispatch latency histogram of the radio and MAC timer events
+ * @param [out] stats latency statistics
+ * @param [in] reset clear the statistics after reading them
+ */
+void lorawan_node_get_latency_stats(struct lorawan_node_latency_stats *stats, bool reset);
+
+/**
+ * @brief Uplink queue message parameters
+ */
+struct lorawan_node_send_params {
+	uint8_t port;
+	bool tx_confirmed;
+	/* 0 is the most urgent, equal priorities are sent in FIFO order */
+	uint8_t priority;
+	/* milliseconds before an unsent message is dropped, 0 keeps it until sent */
+	uint32_t lifetime;
+	/**
+	 * May share one FRMPayload with the other aggregate messages of the same
+	 * port, every message of such a frame is carried as a [size][data] record.
+	 */
+	bool aggregate;
+};
+
+/**
+ * @brief Queues a ClassA uplink, sent as soon as the MAC and the duty cycle allow it
+ * @note Callback data_sent reports the outcome, is_mcps_confirm is false when the
+ *       message was dropped before reaching the air: TX_TIMEOUT when its lifetime
+ *       expired, TX_DR_PAYLOAD_SIZE_ERROR when it can't fit the current datarate.
+ * @param [in] params message parameters
+ * @param [in] data Data to be sent, copied into the queue
+ * @param [in] size Data size
+ * @retval LORAWAN_NODE_STATUS_OK: queued, LORAWAN_NODE_STATUS_BUSY: the queue is full.
+ */
+enum lorawan_node_status lorawan_node_send_queued(const struct lorawan_node_send_params *params,
+						  const void *data, uint8_t size);
+
 /**
  * @brief Instructs the MAC layer to send a ClassA uplink
  * @param [in] appData Data to be sent
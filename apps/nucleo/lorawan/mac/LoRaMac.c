@@ -934,6 +934,19 @@ static void ProcessRadioTxDone( void )
     {
         MacCtx.McpsConfirm.Status = LORAMAC_EVENT_INFO_STATUS_OK;
     }
+
+#if ( USE_PRECOMPUTED_KEYSTREAM == 1 )
+    // Use the wait for the RX windows to prepare the payload keystream of the next uplink
+    if( MacCtx.NvmCtx->NetworkActivation != ACTIVATION_TYPE_NONE )
+    {
+        uint32_t fCntUp = 0;
+
+        if( LoRaMacCryptoGetFCntUp( &fCntUp ) == LORAMAC_CRYPTO_SUCCESS )
+        {
+            LoRaMacCryptoPrecomputeKeystream( MacCtx.NvmCtx->DevAddr, fCntUp );
+        }
+    }
+#endif /* USE_PRECOMPUTED_KEYSTREAM == 1 */
 }
 
 static void PrepareRxDoneAbort( void )
@@ -28,8 +28,8 @@
  *
  * \author    Daniel Jaeckle ( STACKFORCE )
  */
-#include <math.h>
 #include "utilities.h"
+#include "crc.h"
 #include "secure-element.h"
 #include "LoRaMac.h"
 #include "Region.h"
@@ -67,86 +67,182 @@ static LoRaMacClassBNvmCtx_t NvmCtx;
 static LoRaMacClassBCtx_t Ctx;
 
 
+/*!
+ * Rounds a constant expression to the nearest integer at compile time
+ */
+#define CLASSB_ROUND( x )                ( ( ( x ) < 0 ) ? ( int32_t )( ( x ) - 0.5 ) : ( int32_t )( ( x ) + 0.5 ) )
+
+/*!
+ * Worst case drift coefficient of the clock source, in 1e-6 ppm per square degree
+ */
+static const int32_t TempCoefficient = ( RTC_TEMP_COEFFICIENT < 0 ) ?
+                                       CLASSB_ROUND( ( RTC_TEMP_COEFFICIENT - RTC_TEMP_DEV_COEFFICIENT ) * 1e6 ) :
+                                       CLASSB_ROUND( ( RTC_TEMP_COEFFICIENT + RTC_TEMP_DEV_COEFFICIENT ) * 1e6 );
+
+/*!
+ * Lower bound of the turnover temperature of the clock source, in 0.01 degree
+ */
+static const int32_t TempTurnover = CLASSB_ROUND( ( RTC_TEMP_TURNOVER - RTC_TEMP_DEV_TURNOVER ) * 100 );
+
 /*!
  * \brief Computes the temperature compensation for a period of time on a
  *        specific temperature.
  *
+ * The drift is computed in fixed point, the float constants of the
+ * configuration are folded at compile time.
+ *
  * \param [IN] period Time period to compensate
- * \param [IN] temperature Current temperature
+ * \param [IN] temperature Current temperature, in degree Celsius
  *
  * \retval Compensated time period
  */
-static TimerTime_t TimerTempCompensation( TimerTime_t period, float temperature )
+static TimerTime_t TimerTempCompensation( TimerTime_t period, int16_t temperature )
 {
-  float k = RTC_TEMP_COEFFICIENT;
-  float kDev = RTC_TEMP_DEV_COEFFICIENT;
-  float t = RTC_TEMP_TURNOVER;
-  float tDev = RTC_TEMP_DEV_TURNOVER;
-  float interim = 0.0f;
-  float ppm = 0.0f;
-
-  if (k < 0.0f)
-  {
-    ppm = (k - kDev);
-  }
-  else
-  {
-    ppm = (k + kDev);
-  }
-  interim = (temperature - (t - tDev));
-  ppm *=  interim * interim;
-
-  // Calculate the drift in time
-  interim = ((float) period * ppm) / 1000000.0f;
-  // Calculate the resulting time period
-  interim += period;
-  interim = floor(interim);
-
-  if (interim < 0.0f)
-  {
-    interim = (float)period;
-  }
-
-  // Calculate the resulting period
-  return ( UTIL_TIMER_Time_t ) interim;
+    // Distance to the turnover temperature, in 0.01 degree
+    int64_t delta = ( int64_t )temperature * 100 - TempTurnover;
+    // Drift, in 1e-6 ppm. The square is in 1e-4 square degree.
+    int64_t ppm = ( TempCoefficient * delta * delta ) / 10000;
+    // Drift of the period, in 1e-12 ms
+    int64_t drift = ( int64_t )period * ppm;
+    int64_t interim;
+
+    // Round towards minus infinity like floor()
+    interim = drift / 1000000000000LL;
+    if( ( drift % 1000000000000LL ) < 0 )
+    {
+        interim--;
+    }
+    interim += period;
+
+    if( interim < 0 )
+    {
+        interim = period;
+    }
+
+    // Calculate the resulting period
+    return ( TimerTime_t )interim;
 }
 
 /*!
- * Computes the Ping Offset
+ * Number of ping offsets computed per beacon period, the unicast address and
+ * every multicast channel
+ */
+#define CLASSB_NB_PING_OFFSETS           ( LORAMAC_MAX_MC_CTX + 1 )
+
+/*!
+ * Pseudo random values of the ping offsets of a beacon period. Index 0 is
+ * the unicast address, index 1 + i the multicast channel i.
+ */
+typedef struct sPingOffsetCache
+{
+    /*!
+     * Set if the values below have been computed
+     */
+    bool Valid;
+    /*!
+     * Beacon time the values were computed for, modulo 2^32
+     */
+    uint32_t BeaconTime;
+    /*!
+     * Frame addresses the values were computed for
+     */
+    uint32_t Address[CLASSB_NB_PING_OFFSETS];
+    /*!
+     * First 16 bits of the AES output
+     */
+    uint16_t Rand[CLASSB_NB_PING_OFFSETS];
+}PingOffsetCache_t;
+
+/*
+ * Ping offsets of the current beacon period.
+ */
+static PingOffsetCache_t PingOffsetCache;
+
+/*!
+ * Computes the pseudo random values of all the ping offsets of a beacon
+ * period with a single AES pass over one block per address. Nothing is
+ * computed again until the beacon time or an address changes.
  *
  * \param [IN]  beaconTime      - Time of the recent received beacon
- * \param [IN]  address         - Frame address
- * \param [IN]  pingPeriod      - Ping period of the node
- * \param [OUT] pingOffset      - Pseudo random ping offset
  */
-static void ComputePingOffset( uint64_t beaconTime, uint32_t address, uint16_t pingPeriod, uint16_t *pingOffset )
+static void ComputePingOffsets( uint64_t beaconTime )
 {
-    uint8_t buffer[16];
-    uint8_t cipher[16];
-    uint32_t result = 0;
+    uint8_t buffer[16 * CLASSB_NB_PING_OFFSETS];
+    uint8_t cipher[16 * CLASSB_NB_PING_OFFSETS];
+    uint32_t address[CLASSB_NB_PING_OFFSETS];
+    MulticastCtx_t *cur = Ctx.LoRaMacClassBParams.MulticastChannels;
+    bool update = false;
     /* Refer to chapter 15.2 of the LoRaWAN specification v1.1. The beacon time
      * GPS time in seconds modulo 2^32
      */
     uint32_t time = ( beaconTime % ( ( ( uint64_t ) 1 ) << 32 ) );
 
-    memset1( buffer, 0, 16 );
-    memset1( cipher, 0, 16 );
+    address[0] = *Ctx.LoRaMacClassBParams.LoRaMacDevAddr;
+    for( uint8_t i = 1; i < CLASSB_NB_PING_OFFSETS; i++ )
+    {
+        address[i] = ( cur != NULL ) ? cur[i - 1].ChannelParams.Address : 0;
+    }
+
+    if( ( PingOffsetCache.Valid == false ) || ( PingOffsetCache.BeaconTime != time ) )
+    {
+        update = true;
+    }
+    for( uint8_t i = 0; i < CLASSB_NB_PING_OFFSETS; i++ )
+    {
+        if( PingOffsetCache.Address[i] != address[i] )
+        {
+            update = true;
+        }
+    }
+    if( update == false )
+    {
+        return;
+    }
 
-    buffer[0] = ( time ) & 0xFF;
-    buffer[1] = ( time >> 8 ) & 0xFF;
-    buffer[2] = ( time >> 16 ) & 0xFF;
-    buffer[3] = ( time >> 24 ) & 0xFF;
+    memset1( buffer, 0, sizeof( buffer ) );
+    memset1( cipher, 0, sizeof( cipher ) );
 
-    buffer[4] = ( address ) & 0xFF;
-    buffer[5] = ( address >> 8 ) & 0xFF;
-    buffer[6] = ( address >> 16 ) & 0xFF;
-    buffer[7] = ( address >> 24 ) & 0xFF;
+    for( uint8_t i = 0; i < CLASSB_NB_PING_OFFSETS; i++ )
+    {
+        uint8_t *block = &buffer[i * 16];
+
+        block[0] = ( time ) & 0xFF;
+        block[1] = ( time >> 8 ) & 0xFF;
+        block[2] = ( time >> 16 ) & 0xFF;
+        block[3] = ( time >> 24 ) & 0xFF;
+
+        block[4] = ( address[i] ) & 0xFF;
+        block[5] = ( address[i] >> 8 ) & 0xFF;
+        block[6] = ( address[i] >> 16 ) & 0xFF;
+        block[7] = ( address[i] >> 24 ) & 0xFF;
+    }
 
-    SecureElementAesEncrypt( buffer, 16, SLOT_RAND_ZERO_KEY, cipher );
+    SecureElementAesEncrypt( buffer, sizeof( buffer ), SLOT_RAND_ZERO_KEY, cipher );
 
-    result = ( ( ( uint32_t ) cipher[0] ) + ( ( ( uint32_t ) cipher[1] ) * 256 ) );
+    for( uint8_t i = 0; i < CLASSB_NB_PING_OFFSETS; i++ )
+    {
+        PingOffsetCache.Address[i] = address[i];
+        PingOffsetCache.Rand[i] = ( uint16_t )( ( ( uint32_t ) cipher[i * 16] ) + ( ( ( uint32_t ) cipher[i * 16 + 1] ) * 256 ) );
+    }
+    PingOffsetCache.BeaconTime = time;
+    PingOffsetCache.Valid = true;
+}
 
-    *pingOffset = ( uint16_t )( result % pingPeriod );
+/*!
+ * Gets a ping offset of the current beacon period, see ComputePingOffsets
+ *
+ * \param [IN]  index           - 0 for the unicast address, 1 + i for the multicast channel i
+ * \param [IN]  pingPeriod      - Ping period of the address
+ *
+ * \retval Pseudo random ping offset
+ */
+static uint16_t GetPingOffset( uint8_t index, uint16_t pingPeriod )
+{
+    if( pingPeriod == 0 )
+    {
+        return 0;
+    }
+    return PingOffsetCache.Rand[index] % pingPeriod;
 }
 
 /*!
@@ -349,26 +445,8 @@ static bool CalcNextSlotTime( uint16_t slotOffset, uint16_t pingPeriod, uint16_t
  */
 static uint16_t BeaconCrc( uint8_t *buffer, uint16_t length )
 {
-    // The CRC calculation follows CCITT
-    const uint16_t polynom = 0x1021;
-    // CRC initial value
-    uint16_t crc = 0x0000;
-
-    if( buffer == NULL )
-    {
-        return 0;
-    }
-
-    for( uint16_t i = 0; i < length; ++i )
-    {
-        crc ^= ( uint16_t ) buffer[i] << 8;
-        for( uint16_t j = 0; j < 8; ++j )
-        {
-            crc = ( crc & 0x8000 ) ? ( crc << 1 ) ^ polynom : ( crc << 1 );
-        }
-    }
-
-    return crc;
+    // The CRC calculation follows CCITT, with an initial value of 0
+    return Crc16Ccitt( 0x0000, buffer, length );
 }
 
 static void GetTemperature( LoRaMacClassBCallback_t *callbacks, BeaconContext_t *beaconCtx )
@@ -376,7 +454,7 @@ static void GetTemperature( LoRaMacClassBCallback_t *callbacks, BeaconContext_t
     // Measure temperature, if available
     if( ( callbacks != NULL ) && ( callbacks->GetTemperatureLevel != NULL ) )
     {
-        beaconCtx->Temperature = callbacks->GetTemperatureLevel( );
+        beaconCtx->Temperature = ( int16_t )callbacks->GetTemperatureLevel( );
     }
 }
 
@@ -392,9 +470,10 @@ static void InitClassB( void )
     memset1( ( uint8_t* ) &NvmCtx, 0, sizeof( LoRaMacClassBNvmCtx_t ) );
     memset1( ( uint8_t* ) &Ctx.PingSlotCtx, 0, sizeof( PingSlotContext_t ) );
     memset1( ( uint8_t* ) &Ctx.BeaconCtx, 0, sizeof( BeaconContext_t ) );
+    memset1( ( uint8_t* ) &PingOffsetCache, 0, sizeof( PingOffsetCache_t ) );
 
     // Setup default temperature
-    Ctx.BeaconCtx.Temperature = 25.0;
+    Ctx.BeaconCtx.Temperature = 25;
     GetTemperature( &Ctx.LoRaMacClassBCallbacks, &Ctx.BeaconCtx );
 
     // Setup default ping slot datarate
@@ -922,10 +1001,8 @@ static void LoRaMacClassBProcessPingSlot( void )
     {
         case PINGSLOT_STATE_CALC_PING_OFFSET:
         {
-            ComputePingOffset( Ctx.BeaconCtx.BeaconTime.Seconds,
-                               *Ctx.LoRaMacClassBParams.LoRaMacDevAddr,
-                               Ctx.NvmCtx->PingSlotCtx.PingPeriod,
-                               &( Ctx.PingSlotCtx.PingOffset ) );
+            ComputePingOffsets( Ctx.BeaconCtx.BeaconTime.Seconds );
+            Ctx.PingSlotCtx.PingOffset = GetPingOffset( 0, Ctx.NvmCtx->PingSlotCtx.PingPeriod );
             Ctx.PingSlotState = PINGSLOT_STATE_SET_TIMER;
         }
             // Intentional fall through
@@ -1050,13 +1127,12 @@ static void LoRaMacClassBProcessMulticastSlot( void )
     {
         case PINGSLOT_STATE_CALC_PING_OFFSET:
         {
-            // Compute all offsets for every multicast slots
+            // Compute all offsets for every multicast slots, the unicast
+            // ping slot has most likely computed them already
+            ComputePingOffsets( Ctx.BeaconCtx.BeaconTime.Seconds );
             for( uint8_t i = 0; i < LORAMAC_MAX_MC_CTX; i++ )
             {
-                ComputePingOffset( Ctx.BeaconCtx.BeaconTime.Seconds,
-                                   cur->ChannelParams.Address,
-                                   cur->PingPeriod,
-                                   &( cur->PingOffset ) );
+                cur->PingOffset = GetPingOffset( i + 1, cur->PingPeriod );
                 cur++;
             }
             Ctx.MulticastSlotState = PINGSLOT_STATE_SET_TIMER;
@@ -181,9 +181,9 @@ typedef struct sBeaconContext
     }Ctrl;
 
     /*!
-     * Current temperature
+     * Current temperature, in degree Celsius
      */
-    float Temperature;
+    int16_t Temperature;
     /*!
      * Beacon time received with the beacon frame
      */
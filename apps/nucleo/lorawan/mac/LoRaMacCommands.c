@@ -39,43 +39,49 @@
  */
 #define NUM_OF_MAC_COMMANDS 15
 
+#if ( NUM_OF_MAC_COMMANDS > 16 )
+#error "The slot bitmaps hold 16 MAC commands at most"
+#endif
+
+/*!
+ * Bitmap of all the MAC command slots
+ */
+#define ALL_MAC_COMMAND_SLOTS ( ( uint16_t )( ( 1UL << NUM_OF_MAC_COMMANDS ) - 1 ) )
+
 /*!
  * Size of the CID field of MAC commands
  */
 #define CID_FIELD_SIZE 1
 
 /*!
- *  Mac Commands list structure
+ * LoRaMac Commands Context structure
  */
-typedef struct sMacCommandsList
+typedef struct sLoRaMacCommandsCtx
 {
     /*
-     * First element of MAC command list.
+     * Buffer to store MAC command elements
      */
-    MacCommand_t* First;
+    MacCommand_t MacCommandSlots[NUM_OF_MAC_COMMANDS];
     /*
-     * Last element of MAC command list.
+     * Slots of the MAC commands, in the order they were added
      */
-    MacCommand_t* Last;
-} MacCommandsList_t;
-
-/*!
- * LoRaMac Commands Context structure
- */
-typedef struct sLoRaMacCommandsCtx
-{
+    uint8_t Order[NUM_OF_MAC_COMMANDS];
     /*
-     * List of MAC command elements
+     * Number of MAC commands
      */
-    MacCommandsList_t MacCommandList;
+    uint8_t NbOfCmds;
     /*
-     * Buffer to store MAC command elements
+     * Bitmap of the slots in use
      */
-    MacCommand_t MacCommandSlots[NUM_OF_MAC_COMMANDS];
+    uint16_t UsedSlots;
+    /*
+     * Bitmap of the slots holding a sticky MAC command
+     */
+    uint16_t StickySlots;
     /*
      * Size of all MAC commands serialized as buffer
      */
-    size_t SerializedCmdsSize;
+    uint16_t SerializedCmdsSize;
 } LoRaMacCommandsCtx_t;
 
 /*!
@@ -90,192 +96,77 @@ static LoRaMacCommandsCtx_t NvmCtx;
 
 /* Memory management functions */
 
-/*!
- * \brief Determines if a MAC command slot is free
- *
- * \param[IN]     slot           - Slot to check
- * \retval                       - Status of the operation
- */
-static bool IsSlotFree( const MacCommand_t* slot )
-{
-    uint8_t* mem = ( uint8_t* )slot;
-
-    for( uint16_t size = 0; size < sizeof( MacCommand_t ); size++ )
-    {
-        if( mem[size] != 0x00 )
-        {
-            return false;
-        }
-    }
-    return true;
-}
-
 /*!
  * \brief Allocates a new MAC command memory slot
  *
- * \retval                       - Pointer to slot
+ * \retval                       - Slot index, -1 when all slots are used
  */
-static MacCommand_t* MallocNewMacCommandSlot( void )
+static int8_t MallocNewMacCommandSlot( void )
 {
-    uint8_t itr = 0;
+    uint16_t freeSlots = ~NvmCtx.UsedSlots & ALL_MAC_COMMAND_SLOTS;
 
-    while( IsSlotFree( ( const MacCommand_t* )&NvmCtx.MacCommandSlots[itr] ) == false )
+    if( freeSlots == 0 )
     {
-        itr++;
-        if( itr == NUM_OF_MAC_COMMANDS )
-        {
-            return NULL;
-        }
+        return -1;
     }
-
-    return &NvmCtx.MacCommandSlots[itr];
+    return ( int8_t )__builtin_ctz( freeSlots );
 }
 
 /*!
- * \brief Free memory slot
+ * \brief Gets the slot of a MAC command
  *
- * \param[IN]     slot           - Slot to free
- *
- * \retval                       - Status of the operation
+ * \param[IN]     macCmd         - MAC command
+ * \retval                       - Slot index, -1 when macCmd is not a used slot
  */
-static bool FreeMacCommandSlot( MacCommand_t* slot )
+static int8_t GetMacCommandSlot( const MacCommand_t* macCmd )
 {
-    if( slot == NULL )
+    if( ( macCmd < NvmCtx.MacCommandSlots ) || ( macCmd >= &NvmCtx.MacCommandSlots[NUM_OF_MAC_COMMANDS] ) )
     {
-        return false;
+        return -1;
     }
 
-    memset1( ( uint8_t* )slot, 0x00, sizeof( MacCommand_t ) );
-
-    return true;
-}
+    int8_t slot = ( int8_t )( macCmd - NvmCtx.MacCommandSlots );
 
-/* Linked list functions */
-
-/*!
- * \brief Initialize list
- *
- * \param[IN]     list           - List that shall be initialized
- * \retval                       - Status of the operation
- */
-static bool LinkedListInit( MacCommandsList_t* list )
-{
-    if( list == NULL )
+    if( ( NvmCtx.UsedSlots & ( 1U << slot ) ) == 0 )
     {
-        return false;
+        return -1;
     }
-
-    list->First = NULL;
-    list->Last = NULL;
-
-    return true;
+    return slot;
 }
 
 /*!
- * \brief Add an element to the list
+ * \brief Frees memory slots, keeping the order of the remaining MAC commands
  *
- * \param[IN]     list           - List where the element shall be added.
- * \param[IN]     element        - Element to add
- * \retval                       - Status of the operation
+ * \param[IN]     slots          - Bitmap of the slots to free
  */
-static bool LinkedListAdd( MacCommandsList_t* list, MacCommand_t* element )
+static void FreeMacCommandSlots( uint16_t slots )
 {
-    if( ( list == NULL ) || ( element == NULL ) )
-    {
-        return false;
-    }
-
-    // Check if this is the first entry to enter the list.
-    if( list->First == NULL )
-    {
-        list->First = element;
-    }
+    uint8_t nbOfCmds = 0;
 
-    // Check if the last entry exists and update its next point.
-    if( list->Last )
+    slots &= NvmCtx.UsedSlots;
+    if( slots == 0 )
     {
-        list->Last->Next = element;
+        return;
     }
 
-    // Update the next point of this entry.
-    element->Next = NULL;
-
-    // Update the last entry of the list.
-    list->Last = element;
-
-    return true;
-}
-
-/*!
- * \brief Return the previous element in the list.
- *
- * \param[IN]     list           - List
- * \param[IN]     element        - Element where the previous element shall be searched
- * \retval                       - Status of the operation
- */
-static MacCommand_t* LinkedListGetPrevious( MacCommandsList_t* list, MacCommand_t* element )
-{
-    if( ( list == NULL ) || ( element == NULL ) )
+    for( uint8_t i = 0; i < NvmCtx.NbOfCmds; i++ )
     {
-        return NULL;
-    }
-
-    MacCommand_t* curElement;
-
-    // Start at the head of the list
-    curElement = list->First;
+        uint8_t slot = NvmCtx.Order[i];
 
-    // When current element is the first of the list, there's no previous element so we can return NULL immediately.
-    if( element != curElement )
-    {
-        // Loop through all elements until the end is reached or the next of current is the current element.
-        while( ( curElement != NULL ) && ( curElement->Next != element ) )
+        if( ( slots & ( 1U << slot ) ) != 0 )
         {
-            curElement = curElement->Next;
+            NvmCtx.SerializedCmdsSize -= ( CID_FIELD_SIZE + NvmCtx.MacCommandSlots[slot].PayloadSize );
+            memset1( ( uint8_t* )&NvmCtx.MacCommandSlots[slot], 0x00, sizeof( MacCommand_t ) );
+        }
+        else
+        {
+            NvmCtx.Order[nbOfCmds++] = slot;
         }
     }
-    else
-    {
-        curElement = NULL;
-    }
-
-    return curElement;
-}
-
-/*!
- * \brief Remove an element from the list
- *
- * \param[IN]     list           - List where the element shall be removed from.
- * \param[IN]     element        - Element to remove
- * \retval                       - Status of the operation
- */
-static bool LinkedListRemove( MacCommandsList_t* list, MacCommand_t* element )
-{
-    if( ( list == NULL ) || ( element == NULL ) )
-    {
-        return false;
-    }
-
-    MacCommand_t* PrevElement = LinkedListGetPrevious( list, element );
-
-    if( list->First == element )
-    {
-        list->First = element->Next;
-    }
-
-    if( list->Last == element )
-    {
-        list->Last = PrevElement;
-    }
-
-    if( PrevElement != NULL )
-    {
-        PrevElement->Next = element->Next;
-    }
-
-    element->Next = NULL;
 
-    return true;
+    NvmCtx.NbOfCmds = nbOfCmds;
+    NvmCtx.UsedSlots &= ~slots;
+    NvmCtx.StickySlots &= ~slots;
 }
 
 /*
@@ -315,8 +206,6 @@ LoRaMacCommandStatus_t LoRaMacCommandsInit( LoRaMacCommandsNvmEvent commandsNvmC
     // Initialize with default
     memset1( ( uint8_t* )&NvmCtx, 0, sizeof( NvmCtx ) );
 
-    LinkedListInit( &NvmCtx.MacCommandList );
-
     // Assign callback
     CommandsNvmCtxChanged = commandsNvmCtxChanged;
 
@@ -349,27 +238,33 @@ LoRaMacCommandStatus_t LoRaMacCommandsAddCmd( uint8_t cid, uint8_t* payload, siz
     {
         return LORAMAC_COMMANDS_ERROR_NPE;
     }
-    MacCommand_t* newCmd;
+    if( payloadSize > LORAMAC_COMMADS_MAX_NUM_OF_PARAMS )
+    {
+        return LORAMAC_COMMANDS_ERROR;
+    }
 
     // Allocate a memory slot
-    newCmd = MallocNewMacCommandSlot( );
+    int8_t slot = MallocNewMacCommandSlot( );
 
-    if( newCmd == NULL )
+    if( slot < 0 )
     {
         return LORAMAC_COMMANDS_ERROR_MEMORY;
     }
 
-    // Add it to the list of Mac commands
-    if( LinkedListAdd( &NvmCtx.MacCommandList, newCmd ) == false )
-    {
-        return LORAMAC_COMMANDS_ERROR;
-    }
+    MacCommand_t* newCmd = &NvmCtx.MacCommandSlots[slot];
 
     // Set Values
     newCmd->CID = cid;
-    newCmd->PayloadSize = payloadSize;
+    newCmd->PayloadSize = ( uint8_t )payloadSize;
     memcpy1( ( uint8_t* )newCmd->Payload, payload, payloadSize );
-    newCmd->IsSticky = IsSticky( cid );
+
+    // Add it after the other Mac commands
+    NvmCtx.Order[NvmCtx.NbOfCmds++] = ( uint8_t )slot;
+    NvmCtx.UsedSlots |= ( 1U << slot );
+    if( IsSticky( cid ) == true )
+    {
+        NvmCtx.StickySlots |= ( 1U << slot );
+    }
 
     NvmCtx.SerializedCmdsSize += ( CID_FIELD_SIZE + payloadSize );
 
@@ -385,19 +280,15 @@ LoRaMacCommandStatus_t LoRaMacCommandsRemoveCmd( MacCommand_t* macCmd )
         return LORAMAC_COMMANDS_ERROR_NPE;
     }
 
-    // Remove the Mac command element from MacCommandList
-    if( LinkedListRemove( &NvmCtx.MacCommandList, macCmd ) == false )
+    int8_t slot = GetMacCommandSlot( macCmd );
+
+    if( slot < 0 )
     {
         return LORAMAC_COMMANDS_ERROR_CMD_NOT_FOUND;
     }
 
-    NvmCtx.SerializedCmdsSize -= ( CID_FIELD_SIZE + macCmd->PayloadSize );
-
     // Free the MacCommand Slot
-    if( FreeMacCommandSlot( macCmd ) == false )
-    {
-        return LORAMAC_COMMANDS_ERROR;
-    }
+    FreeMacCommandSlots( 1U << slot );
 
     NvmCtxCallback( );
 
@@ -406,50 +297,23 @@ LoRaMacCommandStatus_t LoRaMacCommandsRemoveCmd( MacCommand_t* macCmd )
 
 LoRaMacCommandStatus_t LoRaMacCommandsGetCmd( uint8_t cid, MacCommand_t** macCmd )
 {
-    MacCommand_t* curElement;
-
-    // Start at the head of the list
-    curElement = NvmCtx.MacCommandList.First;
-
     // Loop through all elements until we find the element with the given CID
-    while( ( curElement != NULL ) && ( curElement->CID != cid ) )
+    for( uint8_t i = 0; i < NvmCtx.NbOfCmds; i++ )
     {
-        curElement = curElement->Next;
+        if( NvmCtx.MacCommandSlots[NvmCtx.Order[i]].CID == cid )
+        {
+            *macCmd = &NvmCtx.MacCommandSlots[NvmCtx.Order[i]];
+            return LORAMAC_COMMANDS_SUCCESS;
+        }
     }
 
-    // Update the pointer anyway
-    *macCmd = curElement;
-
-    // Handle error in case if we reached the end without finding it.
-    if( curElement == NULL )
-    {
-        return LORAMAC_COMMANDS_ERROR_CMD_NOT_FOUND;
-    }
-    return LORAMAC_COMMANDS_SUCCESS;
+    *macCmd = NULL;
+    return LORAMAC_COMMANDS_ERROR_CMD_NOT_FOUND;
 }
 
 LoRaMacCommandStatus_t LoRaMacCommandsRemoveNoneStickyCmds( void )
 {
-    MacCommand_t* curElement;
-    MacCommand_t* nexElement;
-
-    // Start at the head of the list
-    curElement = NvmCtx.MacCommandList.First;
-
-    // Loop through all elements
-    while( curElement != NULL )
-    {
-        if( curElement->IsSticky == false )
-        {
-            nexElement = curElement->Next;
-            LoRaMacCommandsRemoveCmd( curElement );
-            curElement = nexElement;
-        }
-        else
-        {
-            curElement = curElement->Next;
-        }
-    }
+    FreeMacCommandSlots( NvmCtx.UsedSlots & ~NvmCtx.StickySlots );
 
     NvmCtxCallback( );
 
@@ -458,22 +322,7 @@ LoRaMacCommandStatus_t LoRaMacCommandsRemoveNoneStickyCmds( void )
 
 LoRaMacCommandStatus_t LoRaMacCommandsRemoveStickyAnsCmds( void )
 {
-    MacCommand_t* curElement;
-    MacCommand_t* nexElement;
-
-    // Start at the head of the list
-    curElement = NvmCtx.MacCommandList.First;
-
-    // Loop through all elements
-    while( curElement != NULL )
-    {
-        nexElement = curElement->Next;
-        if( IsSticky( curElement->CID ) == true )
-        {
-            LoRaMacCommandsRemoveCmd( curElement );
-        }
-        curElement = nexElement;
-    }
+    FreeMacCommandSlots( NvmCtx.StickySlots );
 
     NvmCtxCallback( );
 
@@ -492,9 +341,9 @@ LoRaMacCommandStatus_t LoRaMacCommandsGetSizeSerializedCmds( size_t* size )
 
 LoRaMacCommandStatus_t LoRaMacCommandsSerializeCmds( size_t availableSize, size_t* effectiveSize, uint8_t* buffer )
 {
-    MacCommand_t* curElement = NvmCtx.MacCommandList.First;
-    MacCommand_t* nextElement;
+    uint16_t notFitting = 0;
     uint8_t itr = 0;
+    uint8_t i;
 
     if( ( buffer == NULL ) || ( effectiveSize == NULL ) )
     {
@@ -502,8 +351,10 @@ LoRaMacCommandStatus_t LoRaMacCommandsSerializeCmds( size_t availableSize, size_
     }
 
     // Loop through all elements which fits into the buffer
-    while( curElement != NULL )
+    for( i = 0; i < NvmCtx.NbOfCmds; i++ )
     {
+        MacCommand_t* curElement = &NvmCtx.MacCommandSlots[NvmCtx.Order[i]];
+
         // If the next MAC command still fits into the buffer, add it.
         if( ( availableSize - itr ) >= ( CID_FIELD_SIZE + curElement->PayloadSize ) )
         {
@@ -515,16 +366,17 @@ LoRaMacCommandStatus_t LoRaMacCommandsSerializeCmds( size_t availableSize, size_
         {
             break;
         }
-        curElement = curElement->Next;
     }
 
     // Remove all commands which do not fit into the buffer
-    while( curElement != NULL )
+    for( ; i < NvmCtx.NbOfCmds; i++ )
     {
-        // Store the next element before removing the current one
-        nextElement = curElement->Next;
-        LoRaMacCommandsRemoveCmd( curElement );
-        curElement = nextElement;
+        notFitting |= ( 1U << NvmCtx.Order[i] );
+    }
+    if( notFitting != 0 )
+    {
+        FreeMacCommandSlots( notFitting );
+        NvmCtxCallback( );
     }
 
     // Fetch the effective size of the mac commands
@@ -539,22 +391,8 @@ LoRaMacCommandStatus_t LoRaMacCommandsStickyCmdsPending( bool* cmdsPending )
     {
         return LORAMAC_COMMANDS_ERROR_NPE;
     }
-    MacCommand_t* curElement;
-    curElement = NvmCtx.MacCommandList.First;
 
-    *cmdsPending = false;
-
-    // Loop through all elements
-    while( curElement != NULL )
-    {
-        if( curElement->IsSticky == true )
-        {
-            // Found one sticky MAC command
-            *cmdsPending = true;
-            return LORAMAC_COMMANDS_SUCCESS;
-        }
-        curElement = curElement->Next;
-    }
+    *cmdsPending = ( NvmCtx.StickySlots != 0 );
 
     return LORAMAC_COMMANDS_SUCCESS;
 }
@@ -57,10 +57,6 @@ typedef struct sMacCommand MacCommand_t;
 
 struct sMacCommand
 {
-    /*!
-     *  The pointer to the next MAC Command element in the list
-     */
-    MacCommand_t* Next;
     /*!
      * MAC command identifier
      */
@@ -72,11 +68,7 @@ struct sMacCommand
     /*!
      * Size of MAC command payload
      */
-    size_t PayloadSize;
-    /*!
-     * Indicates if it's a sticky MAC command
-     */
-    bool IsSticky;
+    uint8_t PayloadSize;
 };
 
 /*!
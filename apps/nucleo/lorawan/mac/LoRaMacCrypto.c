@@ -162,6 +162,35 @@ typedef struct sLoRaMacCryptoNvmCtx
     uint32_t* LastDownFCnt;
 }LoRaMacCryptoNvmCtx_t;
 
+#if ( USE_PRECOMPUTED_KEYSTREAM == 1 )
+/*
+ * Keystream of an uplink frame payload
+ */
+typedef struct sKeystream
+{
+    /*
+     * Number of keystream bytes available, 0 if none
+     */
+    uint8_t Size;
+    /*
+     * Key identifier the keystream was computed with
+     */
+    KeyIdentifier_t KeyID;
+    /*
+     * Device address of the uplink
+     */
+    uint32_t Address;
+    /*
+     * Frame counter of the uplink
+     */
+    uint32_t FCnt;
+    /*
+     * Encrypted A blocks
+     */
+    uint8_t Blocks[PRECOMPUTED_KEYSTREAM_BLOCKS * 16];
+}Keystream_t;
+#endif /* USE_PRECOMPUTED_KEYSTREAM == 1 */
+
 /*
  * LoRaMac Crypto Context structure
  */
@@ -181,6 +210,12 @@ typedef struct sLoRaMacCryptoCtx
      * Callback function to notify the upper layer about context change
      */
     LoRaMacCryptoNvmEvent EventCryptoNvmCtxChanged;
+#if ( USE_PRECOMPUTED_KEYSTREAM == 1 )
+    /*
+     * Keystream of the next uplink
+     */
+    Keystream_t Keystream;
+#endif /* USE_PRECOMPUTED_KEYSTREAM == 1 */
 }LoRaMacCryptoCtx_t;
 
 /*
@@ -238,6 +273,43 @@ static KeyAddr_t KeyAddrList[NUM_OF_SEC_CTX] =
  * Local functions
  */
 
+/*
+ * Prepares the A block used for payload encryption, without the block counter
+ *
+ * \param[IN]  address          - Address
+ * \param[IN]  dir              - Frame direction ( Uplink or Downlink )
+ * \param[IN]  frameCounter     - Frame counter
+ * \param[OUT] aBlock           - A block
+ */
+static void PrepareAi( uint32_t address, uint8_t dir, uint32_t frameCounter, uint8_t* aBlock )
+{
+    memset1( aBlock, 0, 16 );
+
+    aBlock[0] = 0x01;
+
+    aBlock[5] = dir;
+
+    aBlock[6] = address & 0xFF;
+    aBlock[7] = ( address >> 8 ) & 0xFF;
+    aBlock[8] = ( address >> 16 ) & 0xFF;
+    aBlock[9] = ( address >> 24 ) & 0xFF;
+
+    aBlock[10] = frameCounter & 0xFF;
+    aBlock[11] = ( frameCounter >> 8 ) & 0xFF;
+    aBlock[12] = ( frameCounter >> 16 ) & 0xFF;
+    aBlock[13] = ( frameCounter >> 24 ) & 0xFF;
+}
+
+#if ( USE_PRECOMPUTED_KEYSTREAM == 1 )
+/*
+ * Drops the precomputed keystream
+ */
+static void ResetKeystream( void )
+{
+    memset1( ( uint8_t* )&CryptoCtx.Keystream, 0, sizeof( Keystream_t ) );
+}
+#endif /* USE_PRECOMPUTED_KEYSTREAM == 1 */
+
 /*
  * Encrypts the payload
  *
@@ -259,21 +331,33 @@ static LoRaMacCryptoStatus_t PayloadEncrypt( uint8_t* buffer, int16_t size, KeyI
     uint8_t bufferIndex = 0;
     uint16_t ctr = 1;
     uint8_t sBlock[16] = { 0 };
-    uint8_t aBlock[16] = { 0 };
+    uint8_t aBlock[16];
 
-    aBlock[0] = 0x01;
-
-    aBlock[5] = dir;
+#if ( USE_PRECOMPUTED_KEYSTREAM == 1 )
+    if( dir == UPLINK )
+    {
+        Keystream_t* keystream = &CryptoCtx.Keystream;
 
-    aBlock[6] = address & 0xFF;
-    aBlock[7] = ( address >> 8 ) & 0xFF;
-    aBlock[8] = ( address >> 16 ) & 0xFF;
-    aBlock[9] = ( address >> 24 ) & 0xFF;
+        if( ( keystream->Size > 0 ) && ( keystream->KeyID == keyID ) &&
+            ( keystream->Address == address ) && ( keystream->FCnt == frameCounter ) )
+        {
+            while( ( size > 0 ) && ( bufferIndex < keystream->Size ) )
+            {
+                for( uint8_t i = 0; i < ( ( size > 16 ) ? 16 : size ); i++ )
+                {
+                    buffer[bufferIndex + i] = buffer[bufferIndex + i] ^ keystream->Blocks[bufferIndex + i];
+                }
+                ctr++;
+                size -= 16;
+                bufferIndex += 16;
+            }
+        }
+        // A keystream is only ever used for one frame
+        ResetKeystream( );
+    }
+#endif /* USE_PRECOMPUTED_KEYSTREAM == 1 */
 
-    aBlock[10] = frameCounter & 0xFF;
-    aBlock[11] = ( frameCounter >> 8 ) & 0xFF;
-    aBlock[12] = ( frameCounter >> 16 ) & 0xFF;
-    aBlock[13] = ( frameCounter >> 24 ) & 0xFF;
+    PrepareAi( address, dir, frameCounter, aBlock );
 
     while( size > 0 )
     {
@@ -958,6 +1042,10 @@ LoRaMacCryptoStatus_t LoRaMacCryptoInit( LoRaMacCryptoNvmEvent cryptoNvmCtxChang
     // Reset frame counters
     ResetFCnts( );
 
+#if ( USE_PRECOMPUTED_KEYSTREAM == 1 )
+    ResetKeystream( );
+#endif /* USE_PRECOMPUTED_KEYSTREAM == 1 */
+
     return LORAMAC_CRYPTO_SUCCESS;
 }
 
@@ -973,6 +1061,9 @@ LoRaMacCryptoStatus_t LoRaMacCryptoRestoreNvmCtx( void* cryptoNvmCtx )
     if( cryptoNvmCtx != 0 )
     {
         memcpy1( ( uint8_t* )&NvmCryptoCtx, ( uint8_t* )cryptoNvmCtx, CRYPTO_NVM_CTX_SIZE );
+#if ( USE_PRECOMPUTED_KEYSTREAM == 1 )
+        ResetKeystream( );
+#endif /* USE_PRECOMPUTED_KEYSTREAM == 1 */
         return LORAMAC_CRYPTO_SUCCESS;
     }
     else
@@ -999,6 +1090,39 @@ LoRaMacCryptoStatus_t LoRaMacCryptoGetFCntUp( uint32_t* currentUp )
     return LORAMAC_CRYPTO_SUCCESS;
 }
 
+#if ( USE_PRECOMPUTED_KEYSTREAM == 1 )
+LoRaMacCryptoStatus_t LoRaMacCryptoPrecomputeKeystream( uint32_t devAddr, uint32_t fCntUp )
+{
+    Keystream_t* keystream = &CryptoCtx.Keystream;
+
+    if( fCntUp <= CryptoCtx.NvmCtx->FCntList.FCntUp )
+    {
+        return LORAMAC_CRYPTO_FAIL_FCNT_SMALLER;
+    }
+
+    ResetKeystream( );
+
+    // Ai = A | i, encrypted in place
+    for( uint8_t i = 0; i < PRECOMPUTED_KEYSTREAM_BLOCKS; i++ )
+    {
+        PrepareAi( devAddr, UPLINK, fCntUp, &keystream->Blocks[i * 16] );
+        keystream->Blocks[i * 16 + 15] = i + 1;
+    }
+    if( SecureElementAesEncrypt( keystream->Blocks, sizeof( keystream->Blocks ), APP_S_KEY, keystream->Blocks ) != SECURE_ELEMENT_SUCCESS )
+    {
+        ResetKeystream( );
+        return LORAMAC_CRYPTO_ERROR_SECURE_ELEMENT_FUNC;
+    }
+
+    keystream->KeyID = APP_S_KEY;
+    keystream->Address = devAddr;
+    keystream->FCnt = fCntUp;
+    keystream->Size = sizeof( keystream->Blocks );
+
+    return LORAMAC_CRYPTO_SUCCESS;
+}
+#endif /* USE_PRECOMPUTED_KEYSTREAM == 1 */
+
 LoRaMacCryptoStatus_t LoRaMacCryptoGetFCntDown( FCntIdentifier_t fCntID, uint16_t maxFCntGap, uint32_t frameFcnt, uint32_t* currentDown )
 {
     uint32_t lastDown = 0;
@@ -1071,6 +1195,9 @@ LoRaMacCryptoStatus_t LoRaMacCryptoSetMulticastReference( MulticastCtx_t* multic
 
 LoRaMacCryptoStatus_t LoRaMacCryptoSetKey( KeyIdentifier_t keyID, uint8_t* key )
 {
+#if ( USE_PRECOMPUTED_KEYSTREAM == 1 )
+    ResetKeystream( );
+#endif /* USE_PRECOMPUTED_KEYSTREAM == 1 */
     if( SecureElementSetKey( keyID, key ) != SECURE_ELEMENT_SUCCESS )
     {
         return LORAMAC_CRYPTO_ERROR_SECURE_ELEMENT_FUNC;
@@ -1370,6 +1497,9 @@ LoRaMacCryptoStatus_t LoRaMacCryptoHandleJoinAccept( JoinReqIdentifier_t joinReq
     CryptoCtx.NvmCtx->FCntList.FCntDown = FCNT_DOWN_INITAL_VALUE;
     CryptoCtx.NvmCtx->FCntList.NFCntDown = FCNT_DOWN_INITAL_VALUE;
     CryptoCtx.NvmCtx->FCntList.AFCntDown = FCNT_DOWN_INITAL_VALUE;
+#if ( USE_PRECOMPUTED_KEYSTREAM == 1 )
+    ResetKeystream( );
+#endif /* USE_PRECOMPUTED_KEYSTREAM == 1 */
 
     CryptoCtx.EventCryptoNvmCtxChanged( );
 
@@ -59,6 +59,16 @@ extern "C"
  */
 #define USE_JOIN_NONCE_COUNTER_CHECK                0
 
+/*!
+ * Indicates if the AppSKey keystream of the next uplink is computed ahead of time
+ */
+#define USE_PRECOMPUTED_KEYSTREAM                   1
+
+/*!
+ * Number of 16 bytes keystream blocks computed ahead of time
+ */
+#define PRECOMPUTED_KEYSTREAM_BLOCKS                4
+
 /*!
  * Initial value of the frame counters
  */
@@ -330,6 +340,21 @@ LoRaMacCryptoStatus_t LoRaMacCryptoDeriveMcKEKey( KeyIdentifier_t keyID );
  */
 LoRaMacCryptoStatus_t LoRaMacCryptoDeriveMcSessionKeyPair( AddressIdentifier_t addrID, uint32_t mcAddr );
 
+#if ( USE_PRECOMPUTED_KEYSTREAM == 1 )
+/*!
+ * Computes the AppSKey keystream of an uplink frame ahead of time, so that
+ * LoRaMacCryptoSecureMessage only has to XOR the FRMPayload with it.
+ *
+ * The keystream is dropped once used and whenever the keys or the frame
+ * counters change.
+ *
+ * \param[IN]     devAddr         - Device address of the uplink
+ * \param[IN]     fCntUp          - Frame counter of the uplink
+ * \retval                        - Status of the operation
+ */
+LoRaMacCryptoStatus_t LoRaMacCryptoPrecomputeKeystream( uint32_t devAddr, uint32_t fCntUp );
+#endif /* USE_PRECOMPUTED_KEYSTREAM == 1 */
+
 /*! \} addtogroup LORAMAC */
 
 #ifdef __cplusplus
@@ -71,6 +71,13 @@ typedef struct sRegionAU915NvmCtx
  */
 static RegionAU915NvmCtx_t NvmCtx;
 
+/*
+ * Time on air of the uplinks, filled on use. One row per uplink datarate up to
+ * DR_6, as long as the longest frame MaxPayloadOfDatarateDwell0AU915 allows.
+ * DR_8 to DR_13 are downlink only.
+ */
+static uint16_t TimeOnAirTable[REGION_COMMON_TOA_ROW_SIZE( 51 ) * 3 + REGION_COMMON_TOA_ROW_SIZE( 115 ) + REGION_COMMON_TOA_ROW_SIZE( 242 ) * 3];
+
 // Static functions
 static int8_t GetNextLowerTxDr( int8_t dr, int8_t minDr )
 {
@@ -140,7 +147,7 @@ static bool VerifyRfFreq( uint32_t freq )
     return true;
 }
 
-static TimerTime_t GetTimeOnAir( int8_t datarate, uint16_t pktLen )
+static TimerTime_t ComputeTimeOnAir( int8_t datarate, uint16_t pktLen )
 {
     int8_t phyDr = DataratesAU915[datarate];
     uint32_t bandwidth = GetBandwidth( datarate );
@@ -148,6 +155,12 @@ static TimerTime_t GetTimeOnAir( int8_t datarate, uint16_t pktLen )
     return Radio.TimeOnAir( MODEM_LORA, bandwidth, phyDr, 1, 8, false, pktLen, true );
 }
 
+static TimerTime_t GetTimeOnAir( int8_t datarate, uint16_t pktLen )
+{
+    return RegionCommonGetTimeOnAir( TimeOnAirTable, sizeof( TimeOnAirTable ) / sizeof( TimeOnAirTable[0] ),
+                                     MaxPayloadOfDatarateDwell0AU915, DR_6, datarate, pktLen, ComputeTimeOnAir );
+}
+
 PhyParam_t RegionAU915GetPhyParam( GetPhyParams_t* getPhy )
 {
     PhyParam_t phyParam = { 0 };
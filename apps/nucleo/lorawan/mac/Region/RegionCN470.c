@@ -64,6 +64,12 @@ typedef struct sRegionCN470NvmCtx
  */
 static RegionCN470NvmCtx_t NvmCtx;
 
+/*
+ * Time on air of the uplinks, filled on use. One row per uplink datarate up to
+ * CN470_TX_MAX_DATARATE, as long as the longest frame MaxPayloadOfDatarateCN470 allows.
+ */
+static uint16_t TimeOnAirTable[REGION_COMMON_TOA_ROW_SIZE( 51 ) * 3 + REGION_COMMON_TOA_ROW_SIZE( 115 ) + REGION_COMMON_TOA_ROW_SIZE( 242 ) * 2];
+
 // Static functions
 static int8_t GetNextLowerTxDr( int8_t dr, int8_t minDr )
 {
@@ -128,7 +134,7 @@ static bool VerifyRfFreq( uint32_t freq )
     return true;
 }
 
-static TimerTime_t GetTimeOnAir( int8_t datarate, uint16_t pktLen )
+static TimerTime_t ComputeTimeOnAir( int8_t datarate, uint16_t pktLen )
 {
     int8_t phyDr = DataratesCN470[datarate];
     uint32_t bandwidth = GetBandwidth( datarate );
@@ -136,6 +142,12 @@ static TimerTime_t GetTimeOnAir( int8_t datarate, uint16_t pktLen )
     return Radio.TimeOnAir( MODEM_LORA, bandwidth, phyDr, 1, 8, false, pktLen, true );
 }
 
+static TimerTime_t GetTimeOnAir( int8_t datarate, uint16_t pktLen )
+{
+    return RegionCommonGetTimeOnAir( TimeOnAirTable, sizeof( TimeOnAirTable ) / sizeof( TimeOnAirTable[0] ),
+                                     MaxPayloadOfDatarateCN470, CN470_TX_MAX_DATARATE, datarate, pktLen, ComputeTimeOnAir );
+}
+
 PhyParam_t RegionCN470GetPhyParam( GetPhyParams_t* getPhy )
 {
     PhyParam_t phyParam = { 0 };
@@ -44,6 +44,40 @@
 #define DUTY_CYCLE_TIME_PERIOD              3600000
 #endif
 
+/*!
+ * Bounds of the channel eligibility cache, CN470 has the most channels (96)
+ * and EU868 the most bands
+ */
+#define CHANNELS_CACHE_MASK_SIZE            6
+#define CHANNELS_CACHE_MAX_NB_BANDS         6
+#define CHANNELS_CACHE_MAX_NB_DR            16
+
+/*!
+ * Channels of the active region which support each datarate and which belong
+ * to each band. Only the channel definitions are cached: the channels mask and
+ * the band readiness change on nearly every uplink and are applied per call.
+ */
+typedef struct sChannelsCache
+{
+    /*!
+     * Channels the cache has been built from
+     */
+    ChannelParams_t* Channels;
+    uint16_t MaxNbChannels;
+    bool Valid;
+    uint8_t NbBands;
+    /*!
+     * Defined channels supporting the datarate, one bit per channel
+     */
+    uint16_t DrChannels[CHANNELS_CACHE_MAX_NB_DR][CHANNELS_CACHE_MASK_SIZE];
+    /*!
+     * Defined channels of the band, one bit per channel
+     */
+    uint16_t BandChannels[CHANNELS_CACHE_MAX_NB_BANDS][CHANNELS_CACHE_MASK_SIZE];
+}ChannelsCache_t;
+
+static ChannelsCache_t ChannelsCache;
+
 static uint16_t GetDutyCycle( Band_t* band, bool joined, SysTime_t elapsedTimeSinceStartup )
 {
     uint16_t joinDutyCycle = RegionCommonGetJoinDc( elapsedTimeSinceStartup );
@@ -135,18 +169,42 @@ static uint16_t UpdateTimeCredits( Band_t* band, bool joined, bool dutyCycleEnab
     return dutyCycle;
 }
 
-static uint8_t CountChannels( uint16_t mask, uint8_t nbBits )
+static void BuildChannelsCache( ChannelParams_t* channels, uint16_t maxNbChannels )
 {
-    uint8_t nbActiveBits = 0;
+    memset1( ( uint8_t* )&ChannelsCache, 0, sizeof( ChannelsCache ) );
+    ChannelsCache.Channels = channels;
+    ChannelsCache.MaxNbChannels = maxNbChannels;
+    ChannelsCache.Valid = true;
 
-    for( uint8_t j = 0; j < nbBits; j++ )
+    for( uint8_t i = 0; i < maxNbChannels; i++ )
     {
-        if( ( mask & ( 1 << j ) ) == ( 1 << j ) )
+        uint16_t bit = 1 << ( i % 16 );
+        uint8_t k = i / 16;
+
+        if( ( channels[i].Frequency == 0 ) || ( channels[i].Band >= CHANNELS_CACHE_MAX_NB_BANDS ) )
+        { // The channel is not enabled
+            continue;
+        }
+        for( uint8_t dr = 0; dr < CHANNELS_CACHE_MAX_NB_DR; dr++ )
         {
-            nbActiveBits++;
+            if( RegionCommonValueInRange( dr, channels[i].DrRange.Fields.Min,
+                                          channels[i].DrRange.Fields.Max ) == true )
+            {
+                ChannelsCache.DrChannels[dr][k] |= bit;
+            }
         }
+        ChannelsCache.BandChannels[channels[i].Band][k] |= bit;
+        ChannelsCache.NbBands = MAX( ChannelsCache.NbBands, channels[i].Band + 1 );
     }
-    return nbActiveBits;
+}
+
+static uint8_t CountChannels( uint16_t mask, uint8_t nbBits )
+{
+    if( nbBits < 16 )
+    {
+        mask &= ( 1 << nbBits ) - 1;
+    }
+    return __builtin_popcount( mask );
 }
 
 uint16_t RegionCommonGetJoinDc( SysTime_t elapsedTime )
@@ -421,6 +479,43 @@ uint32_t RegionCommonComputeSymbolTimeFsk( uint8_t phyDr )
     return 160000UL;
 }
 
+TimerTime_t RegionCommonGetTimeOnAir( uint16_t* timeOnAirTable, uint16_t tableSize, const uint8_t* maxPayloadOfDatarate,
+                                      int8_t maxDr, int8_t datarate, uint16_t pktLen,
+                                      RegionCommonComputeTimeOnAir_t computeTimeOnAir )
+{
+    uint16_t* entry;
+    uint32_t offset = 0;
+    TimerTime_t timeOnAir;
+
+    if( ( datarate < 0 ) || ( datarate > maxDr ) ||
+        ( pktLen >= REGION_COMMON_TOA_ROW_SIZE( maxPayloadOfDatarate[datarate] ) ) )
+    {
+        return computeTimeOnAir( datarate, pktLen );
+    }
+
+    for( int8_t dr = 0; dr < datarate; dr++ )
+    {
+        offset += REGION_COMMON_TOA_ROW_SIZE( maxPayloadOfDatarate[dr] );
+    }
+    if( ( offset + pktLen ) >= tableSize )
+    {
+        return computeTimeOnAir( datarate, pktLen );
+    }
+
+    // A packet always lasts at least its preamble, 0 marks an entry not computed yet
+    entry = &timeOnAirTable[offset + pktLen];
+    if( *entry == 0 )
+    {
+        timeOnAir = computeTimeOnAir( datarate, pktLen );
+        if( timeOnAir > UINT16_MAX )
+        {
+            return timeOnAir;
+        }
+        *entry = ( uint16_t )timeOnAir;
+    }
+    return *entry;
+}
+
 void RegionCommonComputeRxWindowParameters( uint32_t tSymbol, uint8_t minRxSymbols, uint32_t rxError, uint32_t wakeUpTime, uint32_t* windowTimeout, int32_t* windowOffset )
 {
   *windowTimeout = MAX( (uint32_t)2 * minRxSymbols - 8 + DIVC(2 * rxError * 1000000UL, tSymbol ), minRxSymbols);
@@ -467,45 +562,66 @@ void RegionCommonRxBeaconSetup( RegionCommonRxBeaconSetupParams_t* rxBeaconSetup
     MW_LOG(TS_ON, VLEVEL_M, "RX_BC on freq %d Hz at DR %d\r\n", rxBeaconSetupParams->Frequency, rxBeaconSetupParams->BeaconDatarate );
 }
 
+void RegionCommonChannelsChanged( void )
+{
+    ChannelsCache.Valid = false;
+}
+
 void RegionCommonCountNbOfEnabledChannels( RegionCommonCountNbOfEnabledChannelsParams_t* countNbOfEnabledChannelsParams,
                                            uint8_t* enabledChannels, uint8_t* nbEnabledChannels, uint8_t* nbRestrictedChannels )
 {
     uint8_t nbChannelCount = 0;
     uint8_t nbRestrictedChannelsCount = 0;
+    uint16_t readyChannels[CHANNELS_CACHE_MASK_SIZE] = { 0 };
+    uint16_t* drChannels;
 
-    for( uint8_t i = 0, k = 0; i < countNbOfEnabledChannelsParams->MaxNbChannels; i += 16, k++ )
+    if( ( ChannelsCache.Valid == false ) ||
+        ( ChannelsCache.Channels != countNbOfEnabledChannelsParams->Channels ) ||
+        ( ChannelsCache.MaxNbChannels != countNbOfEnabledChannelsParams->MaxNbChannels ) )
+    { // The channel definitions have changed
+        BuildChannelsCache( countNbOfEnabledChannelsParams->Channels, countNbOfEnabledChannelsParams->MaxNbChannels );
+    }
+
+    if( countNbOfEnabledChannelsParams->Datarate >= CHANNELS_CACHE_MAX_NB_DR )
+    { // No channel supports the datarate
+        *nbEnabledChannels = 0;
+        *nbRestrictedChannels = 0;
+        return;
+    }
+    drChannels = ChannelsCache.DrChannels[countNbOfEnabledChannelsParams->Datarate];
+
+    // The band readiness has just been refreshed by RegionCommonUpdateBandTimeOff
+    for( uint8_t b = 0; b < ChannelsCache.NbBands; b++ )
     {
-        for( uint8_t j = 0; j < 16; j++ )
+        if( countNbOfEnabledChannelsParams->Bands[b].ReadyForTransmission == true )
         {
-            if( ( countNbOfEnabledChannelsParams->ChannelsMask[k] & ( 1 << j ) ) != 0 )
+            for( uint8_t k = 0; k < CHANNELS_CACHE_MASK_SIZE; k++ )
             {
-                if( countNbOfEnabledChannelsParams->Channels[i + j].Frequency == 0 )
-                { // Check if the channel is enabled
-                    continue;
-                }
-                if( ( countNbOfEnabledChannelsParams->Joined == false ) &&
-                    ( countNbOfEnabledChannelsParams->JoinChannels > 0 ) )
-                {
-                    if( ( countNbOfEnabledChannelsParams->JoinChannels & ( 1 << j ) ) == 0 )
-                    {
-                        continue;
-                    }
-                }
-                if( RegionCommonValueInRange( countNbOfEnabledChannelsParams->Datarate,
-                                              countNbOfEnabledChannelsParams->Channels[i + j].DrRange.Fields.Min,
-                                              countNbOfEnabledChannelsParams->Channels[i + j].DrRange.Fields.Max ) == false )
-                { // Check if the current channel selection supports the given datarate
-                    continue;
-                }
-                if( countNbOfEnabledChannelsParams->Bands[countNbOfEnabledChannelsParams->Channels[i + j].Band].ReadyForTransmission == false )
-                { // Check if the band is available for transmission
-                    nbRestrictedChannelsCount++;
-                    continue;
-                }
-                enabledChannels[nbChannelCount++] = i + j;
+                readyChannels[k] |= ChannelsCache.BandChannels[b][k];
             }
         }
     }
+
+    for( uint8_t i = 0, k = 0; i < countNbOfEnabledChannelsParams->MaxNbChannels; i += 16, k++ )
+    {
+        uint16_t mask = countNbOfEnabledChannelsParams->ChannelsMask[k] & drChannels[k];
+
+        if( ( countNbOfEnabledChannelsParams->Joined == false ) &&
+            ( countNbOfEnabledChannelsParams->JoinChannels > 0 ) )
+        { // Only the join channels are candidates
+            mask &= countNbOfEnabledChannelsParams->JoinChannels;
+        }
+
+        // Channels of a band still in its time-off
+        nbRestrictedChannelsCount += __builtin_popcount( mask & ~readyChannels[k] );
+
+        mask &= readyChannels[k];
+        while( mask != 0 )
+        {
+            enabledChannels[nbChannelCount++] = i + __builtin_ctz( mask );
+            mask &= mask - 1;
+        }
+    }
     *nbEnabledChannels = nbChannelCount;
     *nbRestrictedChannels = nbRestrictedChannelsCount;
 }
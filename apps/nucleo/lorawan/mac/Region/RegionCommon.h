@@ -54,6 +54,29 @@ extern "C"
  */
 #define REGION_COMMON_DEFAULT_PING_SLOT_PERIODICITY     7
 
+#ifndef REGION_COMMON_TOA_TABLE_MAX_LEN
+/*!
+ * Largest packet length held by the region time on air tables. Longer
+ * packets are always computed.
+ */
+#define REGION_COMMON_TOA_TABLE_MAX_LEN                 255
+#endif
+
+/*!
+ * Number of entries of the time on air table row of a datarate whose
+ * FRMPayload is at most maxPayload: one per PHY payload length up to the
+ * longest frame of that datarate, none when the datarate carries no payload.
+ */
+#define REGION_COMMON_TOA_ROW_SIZE( maxPayload )                                                           \
+    ( ( ( maxPayload ) == 0 ) ? 0 :                                                                        \
+      ( ( ( ( maxPayload ) + LORAMAC_FRAME_PAYLOAD_OVERHEAD_SIZE ) < REGION_COMMON_TOA_TABLE_MAX_LEN ) ?   \
+        ( ( maxPayload ) + LORAMAC_FRAME_PAYLOAD_OVERHEAD_SIZE ) : REGION_COMMON_TOA_TABLE_MAX_LEN ) + 1 )
+
+/*!
+ * Region specific time on air computation, in ms
+ */
+typedef TimerTime_t ( *RegionCommonComputeTimeOnAir_t )( int8_t datarate, uint16_t pktLen );
+
 typedef struct sRegionCommonLinkAdrParams
 {
     /*!
@@ -438,6 +461,35 @@ uint32_t RegionCommonComputeSymbolTimeLoRa( uint8_t phyDr, uint32_t bandwidth );
  */
 uint32_t RegionCommonComputeSymbolTimeFsk( uint8_t phyDr );
 
+/*!
+ * \brief Gets the time on air of an uplink from the region table.
+ *
+ * The table is filled on first use of each entry, then a lookup replaces
+ * the time on air formula. It holds the rows of the datarates 0 to maxDr one
+ * after the other, each of REGION_COMMON_TOA_ROW_SIZE( maxPayloadOfDatarate[dr] )
+ * entries. Other datarates and packets longer than their row are computed on
+ * every call.
+ *
+ * \param [IN] timeOnAirTable Table of the uplink datarate rows.
+ *
+ * \param [IN] tableSize Number of entries of timeOnAirTable.
+ *
+ * \param [IN] maxPayloadOfDatarate Largest FRMPayload of each datarate.
+ *
+ * \param [IN] maxDr Highest datarate covered by the table.
+ *
+ * \param [IN] datarate The uplink datarate.
+ *
+ * \param [IN] pktLen The PHY payload length.
+ *
+ * \param [IN] computeTimeOnAir The region time on air computation.
+ *
+ * \retval Time on air in ms.
+ */
+TimerTime_t RegionCommonGetTimeOnAir( uint16_t* timeOnAirTable, uint16_t tableSize, const uint8_t* maxPayloadOfDatarate,
+                                      int8_t maxDr, int8_t datarate, uint16_t pktLen,
+                                      RegionCommonComputeTimeOnAir_t computeTimeOnAir );
+
 /*!
  * \brief Computes the RX window timeout and the RX window offset.
  *
@@ -480,6 +532,12 @@ int8_t RegionCommonComputeTxPower( int8_t txPowerIndex, float maxEirp, float ant
  */
 void RegionCommonRxBeaconSetup( RegionCommonRxBeaconSetupParams_t* rxBeaconSetupParams );
 
+/*!
+ * \brief Drops the cached channel eligibility. To be called whenever the
+ *        channel definitions (frequency, datarate range or band) change.
+ */
+void RegionCommonChannelsChanged( void );
+
 /*!
  * \brief Counts the number of enabled channels.
  *
@@ -1943,35 +1943,21 @@ static void RadioTxCw( int8_t power )
 static void payload_integration( uint8_t *outBuffer, uint8_t *inBuffer, uint8_t size)
 {
   uint8_t prevInt=0;
-  uint8_t currBit;
-  uint8_t index_bit;
-  uint8_t index_byte;
-  uint8_t index_bit_out;
-  uint8_t index_byte_out;
+  uint8_t integ;
   int i=0;
 
   for (i=0; i<size; i++)
   {
-    /*reverse all inputs*/
-    inBuffer[i]=~inBuffer[i];
-    /*init outBuffer*/
-    outBuffer[i]=0;
-  }
-
-  for (i=0; i<size*8; i++)
-  {
-    /*index to take bit in inBuffer*/
-    index_bit = 7 - (i%8);
-    index_byte = i / 8;
-    /*index to place bit in outBuffer is shifted 1 bit rigth*/
-    index_bit_out = 7 - ((i+1)%8);
-    index_byte_out = (i+1) / 8;
-    /*extract current bit from input*/
-    currBit = (inBuffer[index_byte] >> index_bit) & 0x01; 
-    /*integration*/
-    prevInt ^= currBit;
-    /* write result integration in output*/
-    outBuffer[index_byte_out]|= (prevInt << index_bit_out);
+    /*reverse the input, then integrate its bits msb first: bit n is the xor of bits 7..n*/
+    integ = ~inBuffer[i];
+    integ ^= integ >> 1;
+    integ ^= integ >> 2;
+    integ ^= integ >> 4;
+    /*carry the integration of the previous bytes*/
+    integ ^= (uint8_t)(0 - prevInt);
+    /*output is shifted 1 bit rigth, its msb is the last bit of the previous byte*/
+    outBuffer[i] = (prevInt << 7) | (integ >> 1);
+    prevInt = integ & 0x01;
   }
 
   outBuffer[size] =(prevInt<<7) | (prevInt<<6) | (( (!prevInt) & 0x01)<<5) ;
@@ -31,6 +31,7 @@
   ******************************************************************************
   */
 /* Includes ------------------------------------------------------------------*/
+#include <string.h>
 #include "radio_driver.h" 
 #include "radio_config.h"
 #include "log_config.h"
@@ -51,6 +52,34 @@ typedef struct
     uint8_t       Value;                            //!< The value of the register
 }RadioRegisters_t;
 
+/*!
+ * \brief Shadowed radio configuration commands
+ */
+typedef enum
+{
+    SHADOW_CMD_PACKET_TYPE,
+    SHADOW_CMD_MODULATION_PARAMS,
+    SHADOW_CMD_PACKET_PARAMS,
+    SHADOW_CMD_RF_FREQUENCY,
+    SHADOW_CMD_PA_CONFIG,
+    SHADOW_CMD_TX_PARAMS,
+    SHADOW_CMD_DIO_IRQ_PARAMS,
+    SHADOW_CMD_BUFFER_BASE_ADDRESS,
+    SHADOW_CMD_SYNC_WORD,
+    SHADOW_CMD_OCP,
+    SHADOW_CMD_COUNT
+}RadioShadowCmd_t;
+
+/*!
+ * \brief Last value written by a configuration command
+ */
+typedef struct
+{
+    bool          Valid;                            //!< Set once the value below is known to be in the radio
+    uint8_t       Size;                             //!< Size of the command parameters
+    uint8_t       Value[9];                         //!< The command parameters
+}RadioShadow_t;
+
 /* Private define ------------------------------------------------------------*/
 
 /*!
@@ -97,9 +126,41 @@ static volatile RadioLoRaPacketLengthsMode_t LoRaHeaderType;
 volatile uint32_t FrequencyError = 0;
 
 /*!
- * \brief Hold the status of the Image calibration
+ * \brief Image calibration settings of the frequency bands, highest first
+ */
+static const struct
+{
+    uint32_t      MinFreq;                          //!< Band applies above this frequency
+    uint8_t       CalFreq[2];                       //!< CalibrateImage parameters
+}ImageCalibrationBands[] =
+{
+    { 900000000, { 0xE1, 0xE9 } },
+    { 850000000, { 0xD7, 0xDB } },
+    { 770000000, { 0xC1, 0xC5 } },
+    { 460000000, { 0x75, 0x81 } },
+    {         0, { 0x6B, 0x6F } },
+};
+
+/*!
+ * \brief Band of the last image calibration, -1 when the radio holds none
+ */
+static int8_t ImageCalibratedBand = -1;
+
+/*!
+ * \brief Image calibration counters
+ */
+static SubgRfImageCalibrationStats_t ImageCalibrationStats;
+
+/*!
+ * \brief Configuration last programmed into the radio, kept across warm
+ *        sleeps which retain it
  */
-static bool ImageCalibrated = false;
+static RadioShadow_t RadioShadow[SHADOW_CMD_COUNT];
+
+/*!
+ * \brief Counters of the configuration writes skipped thanks to the shadow
+ */
+static SubgRfShadowStats_t RadioShadowStats;
 
 /* Private function prototypes -----------------------------------------------*/
 
@@ -113,6 +174,55 @@ static void Radio_SMPS_Set( uint8_t level );
  */
 static DioIrqHandler RadioOnDioIrqCb;
 
+/*!
+ * \brief Tells whether a configuration write would change the radio state,
+ *        and records the new value when it does
+ *
+ * \param [IN] cmd  Shadowed command
+ * \param [IN] buf  Command parameters
+ * \param [IN] size Size of the parameters
+ * \param [IN] cost SPI bytes of the write, opcode and address included
+ * \retval true when the write must be done
+ */
+static bool RadioShadowUpdate( RadioShadowCmd_t cmd, const uint8_t *buf, uint8_t size, uint8_t cost )
+{
+    RadioShadow_t *shadow = &RadioShadow[cmd];
+
+    if( ( shadow->Valid == true ) && ( shadow->Size == size ) && ( memcmp( shadow->Value, buf, size ) == 0 ) )
+    {
+        RadioShadowStats.WritesSkipped++;
+        RadioShadowStats.BytesSaved += cost;
+        return false;
+    }
+
+    RADIO_MEMCPY8( shadow->Value, buf, size );
+    shadow->Size = size;
+    shadow->Valid = true;
+    return true;
+}
+
+/*!
+ * \brief Writes a configuration command unless the radio already holds it
+ */
+static void RadioWriteCommandShadowed( RadioShadowCmd_t cmd, SUBGHZ_RadioSetCmd_t command, uint8_t *buf, uint8_t size )
+{
+    if( RadioShadowUpdate( cmd, buf, size, size + 1 ) == true )
+    {
+        SUBGRF_WriteCommand( command, buf, size );
+    }
+}
+
+/*!
+ * \brief Writes configuration registers unless the radio already holds them
+ */
+static void RadioWriteRegistersShadowed( RadioShadowCmd_t cmd, uint16_t address, uint8_t *buf, uint8_t size )
+{
+    if( RadioShadowUpdate( cmd, buf, size, size + 3 ) == true )
+    {
+        SUBGRF_WriteRegisters( address, buf, size );
+    }
+}
+
 /* Exported functions ---------------------------------------------------------*/
 void SUBGRF_Init( DioIrqHandler dioIrq )
 {
@@ -126,7 +236,8 @@ void SUBGRF_Init( DioIrqHandler dioIrq )
 
     RADIO_INIT();
 
-    ImageCalibrated = false;
+    ImageCalibratedBand = -1;
+    SUBGRF_InvalidateShadow( );
 
     SUBGRF_SetStandby( STDBY_RC );
 
@@ -183,7 +294,7 @@ void SUBGRF_SendPayload( uint8_t *payload, uint8_t size, uint32_t timeout)
 
 uint8_t SUBGRF_SetSyncWord( uint8_t *syncWord )
 {
-    SUBGRF_WriteRegisters( REG_LR_SYNCWORDBASEADDRESS, syncWord, 8 );
+    RadioWriteRegistersShadowed( SHADOW_CMD_SYNC_WORD, REG_LR_SYNCWORDBASEADDRESS, syncWord, 8 );
     return 0;
 }
 
@@ -278,6 +389,23 @@ void SUBGRF_SetSleep( SleepParams_t sleepConfig )
                       ( ( uint8_t )sleepConfig.Fields.WakeUpRTC ) );
     SUBGRF_WriteCommand( RADIO_SET_SLEEP, &value, 1 );
     OperatingMode = MODE_SLEEP;
+
+    if( sleepConfig.Fields.WarmStart == 0 )
+    {
+        // A cold start loses the configuration and the image calibration
+        SUBGRF_InvalidateShadow( );
+        ImageCalibratedBand = -1;
+    }
+}
+
+void SUBGRF_InvalidateShadow( void )
+{
+    RADIO_MEMSET8( RadioShadow, 0, sizeof( RadioShadow ) );
+}
+
+void SUBGRF_GetShadowStats( SubgRfShadowStats_t *stats )
+{
+    *stats = RadioShadowStats;
 }
 
 void SUBGRF_SetStandby( RadioStandbyModes_t standbyConfig )
@@ -427,34 +555,31 @@ void SUBGRF_Calibrate( CalibrationParams_t calibParam )
 
 void SUBGRF_CalibrateImage( uint32_t freq )
 {
-    uint8_t calFreq[2];
+    int8_t band = 0;
 
-    if( freq > 900000000 )
+    // The last band covers every frequency left, including 0
+    while( ( band < ( int8_t )( ( sizeof( ImageCalibrationBands ) / sizeof( ImageCalibrationBands[0] ) ) - 1 ) ) &&
+           ( freq <= ImageCalibrationBands[band].MinFreq ) )
     {
-        calFreq[0] = 0xE1;
-        calFreq[1] = 0xE9;
+        band++;
     }
-    else if( freq > 850000000 )
-    {
-        calFreq[0] = 0xD7;
-        calFreq[1] = 0xDB;
-    }
-    else if( freq > 770000000 )
-    {
-        calFreq[0] = 0xC1;
-        calFreq[1] = 0xC5;
-    }
-    else if( freq > 460000000 )
-    {
-        calFreq[0] = 0x75;
-        calFreq[1] = 0x81;
-    }
-    else if( freq > 425000000 )
+
+    if( band == ImageCalibratedBand )
     {
-        calFreq[0] = 0x6B;
-        calFreq[1] = 0x6F;
+        // The radio keeps the calibration of the band until a cold start
+        ImageCalibrationStats.Skipped++;
+        return;
     }
-    SUBGRF_WriteCommand( RADIO_CALIBRATEIMAGE, calFreq, 2 );
+
+    SUBGRF_WriteCommand( RADIO_CALIBRATEIMAGE, ( uint8_t* )ImageCalibrationBands[band].CalFreq, 2 );
+    ImageCalibrationStats.Count++;
+
+    ImageCalibratedBand = band;
+}
+
+void SUBGRF_GetImageCalibrationStats( SubgRfImageCalibrationStats_t *stats )
+{
+    *stats = ImageCalibrationStats;
 }
 
 void SUBGRF_SetPaConfig( uint8_t paDutyCycle, uint8_t hpMax, uint8_t deviceSel, uint8_t paLut )
@@ -465,7 +590,12 @@ void SUBGRF_SetPaConfig( uint8_t paDutyCycle, uint8_t hpMax, uint8_t deviceSel,
     buf[1] = hpMax;
     buf[2] = deviceSel;
     buf[3] = paLut;
-    SUBGRF_WriteCommand( RADIO_SET_PACONFIG, buf, 4 );
+    if( RadioShadowUpdate( SHADOW_CMD_PA_CONFIG, buf, 4, 5 ) == true )
+    {
+        // The radio sets the OCP back to its default on each PA configuration
+        RadioShadow[SHADOW_CMD_OCP].Valid = false;
+        SUBGRF_WriteCommand( RADIO_SET_PACONFIG, buf, 4 );
+    }
 }
 
 void SUBGRF_SetRxTxFallbackMode( uint8_t fallbackMode )
@@ -485,7 +615,7 @@ void SUBGRF_SetDioIrqParams( uint16_t irqMask, uint16_t dio1Mask, uint16_t dio2M
     buf[5] = ( uint8_t )( dio2Mask & 0x00FF );
     buf[6] = ( uint8_t )( ( dio3Mask >> 8 ) & 0x00FF );
     buf[7] = ( uint8_t )( dio3Mask & 0x00FF );
-    SUBGRF_WriteCommand( RADIO_CFG_DIOIRQ, buf, 8 );
+    RadioWriteCommandShadowed( SHADOW_CMD_DIO_IRQ_PARAMS, RADIO_CFG_DIOIRQ, buf, 8 );
 }
 
 uint16_t SUBGRF_GetIrqStatus( void )
@@ -515,11 +645,7 @@ void SUBGRF_SetRfFrequency( uint32_t frequency )
 
     frequency+= RF_FREQUENCY_ERROR;
 
-    if( ImageCalibrated == false )
-    {
-        SUBGRF_CalibrateImage( frequency );
-        ImageCalibrated = true;
-    }
+    SUBGRF_CalibrateImage( frequency );
     /* ST_WORKAROUND_BEGIN: Simplified frequency calculation */
     SX_FREQ_TO_CHANNEL(chan, frequency);   
     /* ST_WORKAROUND_END */
@@ -527,7 +653,7 @@ void SUBGRF_SetRfFrequency( uint32_t frequency )
     buf[1] = ( uint8_t )( ( chan >> 16 ) & 0xFF );
     buf[2] = ( uint8_t )( ( chan >> 8 ) & 0xFF );
     buf[3] = ( uint8_t )( chan & 0xFF );
-    SUBGRF_WriteCommand( RADIO_SET_RFFREQUENCY, buf, 4 );
+    RadioWriteCommandShadowed( SHADOW_CMD_RF_FREQUENCY, RADIO_SET_RFFREQUENCY, buf, 4 );
 }
 
 void SUBGRF_SetPacketType( RadioPacketTypes_t packetType )
@@ -539,7 +665,13 @@ void SUBGRF_SetPacketType( RadioPacketTypes_t packetType )
     {
         SUBGRF_WriteRegister( REG_BIT_SYNC, 0x00 );
     }
-    SUBGRF_WriteCommand( RADIO_SET_PACKETTYPE, ( uint8_t* )&packetType, 1 );
+    if( RadioShadowUpdate( SHADOW_CMD_PACKET_TYPE, ( uint8_t* )&packetType, 1, 2 ) == true )
+    {
+        // The modulation and packet parameters do not survive a packet type change
+        RadioShadow[SHADOW_CMD_MODULATION_PARAMS].Valid = false;
+        RadioShadow[SHADOW_CMD_PACKET_PARAMS].Valid = false;
+        SUBGRF_WriteCommand( RADIO_SET_PACKETTYPE, ( uint8_t* )&packetType, 1 );
+    }
 }
 
 RadioPacketTypes_t SUBGRF_GetPacketType( void )
@@ -569,7 +701,7 @@ void SUBGRF_SetTxParams( uint8_t paSelect, int8_t power, RadioRampTimes_t rampTi
         {
             power = -17;
         }
-        SUBGRF_WriteRegister( REG_OCP, 0x18 ); // current max is 80 mA for the whole device
+        RadioWriteRegistersShadowed( SHADOW_CMD_OCP, REG_OCP, ( uint8_t[] ){ 0x18 }, 1 ); // current max is 80 mA for the whole device
     }
     else // rfo_hp
     {
@@ -587,11 +719,11 @@ void SUBGRF_SetTxParams( uint8_t paSelect, int8_t power, RadioRampTimes_t rampTi
         {
             power = -9;
         }
-        SUBGRF_WriteRegister( REG_OCP, 0x38 ); // current max 160mA for the whole device
+        RadioWriteRegistersShadowed( SHADOW_CMD_OCP, REG_OCP, ( uint8_t[] ){ 0x38 }, 1 ); // current max 160mA for the whole device
     }
     buf[0] = power;
     buf[1] = ( uint8_t )rampTime;
-    SUBGRF_WriteCommand( RADIO_SET_TXPARAMS, buf, 2 );
+    RadioWriteCommandShadowed( SHADOW_CMD_TX_PARAMS, RADIO_SET_TXPARAMS, buf, 2 );
 }
 
 void SUBGRF_SetModulationParams( ModulationParams_t *modulationParams )
@@ -623,7 +755,7 @@ void SUBGRF_SetModulationParams( ModulationParams_t *modulationParams )
         buf[5] = ( tempVal >> 16 ) & 0xFF;
         buf[6] = ( tempVal >> 8 ) & 0xFF;
         buf[7] = ( tempVal& 0xFF );
-        SUBGRF_WriteCommand( RADIO_SET_MODULATIONPARAMS, buf, n );
+        RadioWriteCommandShadowed( SHADOW_CMD_MODULATION_PARAMS, RADIO_SET_MODULATIONPARAMS, buf, n );
         break;
     case PACKET_TYPE_BPSK:
         n = 4;
@@ -632,7 +764,7 @@ void SUBGRF_SetModulationParams( ModulationParams_t *modulationParams )
         buf[1] = ( tempVal >> 8 ) & 0xFF;
         buf[2] = tempVal & 0xFF;
         buf[3] = modulationParams->Params.Bpsk.ModulationShaping;
-        SUBGRF_WriteCommand( RADIO_SET_MODULATIONPARAMS, buf, n );
+        RadioWriteCommandShadowed( SHADOW_CMD_MODULATION_PARAMS, RADIO_SET_MODULATIONPARAMS, buf, n );
         break;
     case PACKET_TYPE_LORA:
         n = 4;
@@ -641,7 +773,7 @@ void SUBGRF_SetModulationParams( ModulationParams_t *modulationParams )
         buf[2] = modulationParams->Params.LoRa.CodingRate;
         buf[3] = modulationParams->Params.LoRa.LowDatarateOptimize;
 
-        SUBGRF_WriteCommand( RADIO_SET_MODULATIONPARAMS, buf, n );
+        RadioWriteCommandShadowed( SHADOW_CMD_MODULATION_PARAMS, RADIO_SET_MODULATIONPARAMS, buf, n );
 
         break;
     case PACKET_TYPE_GMSK:
@@ -652,7 +784,7 @@ void SUBGRF_SetModulationParams( ModulationParams_t *modulationParams )
         buf[2] = tempVal & 0xFF;
         buf[3] = modulationParams->Params.Gfsk.ModulationShaping;
         buf[4] = modulationParams->Params.Gfsk.Bandwidth;
-        SUBGRF_WriteCommand( RADIO_SET_MODULATIONPARAMS, buf, n );
+        RadioWriteCommandShadowed( SHADOW_CMD_MODULATION_PARAMS, RADIO_SET_MODULATIONPARAMS, buf, n );
         break;
     default:
     case PACKET_TYPE_NONE:
@@ -721,7 +853,7 @@ void SUBGRF_SetPacketParams( PacketParams_t *packetParams )
     case PACKET_TYPE_NONE:
         return;
     }
-    SUBGRF_WriteCommand( RADIO_SET_PACKETPARAMS, buf, n );
+    RadioWriteCommandShadowed( SHADOW_CMD_PACKET_PARAMS, RADIO_SET_PACKETPARAMS, buf, n );
 }
 
 void SUBGRF_SetCadParams( RadioLoRaCadSymbols_t cadSymbolNum, uint8_t cadDetPeak, uint8_t cadDetMin, RadioCadExitModes_t cadExitMode, uint32_t cadTimeout )
@@ -745,7 +877,7 @@ void SUBGRF_SetBufferBaseAddress( uint8_t txBaseAddress, uint8_t rxBaseAddress )
 
     buf[0] = txBaseAddress;
     buf[1] = rxBaseAddress;
-    SUBGRF_WriteCommand( RADIO_SET_BUFFERBASEADDRESS, buf, 2 );
+    RadioWriteCommandShadowed( SHADOW_CMD_BUFFER_BASE_ADDRESS, RADIO_SET_BUFFERBASEADDRESS, buf, 2 );
 }
 
 RadioStatus_t SUBGRF_GetStatus( void )
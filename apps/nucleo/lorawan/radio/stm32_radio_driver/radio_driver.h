@@ -757,6 +757,24 @@ typedef enum
  */
 typedef void ( *DioIrqHandler )( RadioIrqMasks_t radioIrq );
 
+/*!
+ * \brief Configuration writes skipped because the radio already held the value
+ */
+typedef struct
+{
+    uint32_t WritesSkipped;                         //!< Number of skipped commands and register writes
+    uint32_t BytesSaved;                            //!< SPI bytes not transferred
+}SubgRfShadowStats_t;
+
+/*!
+ * \brief Image calibration counters
+ */
+typedef struct
+{
+    uint32_t Count;                                 //!< Number of image calibrations run
+    uint32_t Skipped;                               //!< Number of calibrations skipped, the band was already calibrated
+}SubgRfImageCalibrationStats_t;
+
 
 
 #define RX_BUFFER_SIZE                              256
@@ -955,10 +973,19 @@ void SUBGRF_Calibrate( CalibrationParams_t calibParam );
 /*!
  * \brief Calibrates the Image rejection depending of the frequency
  *
+ * \remark Does nothing when the band of freq is the one calibrated last
+ *
  * \param [in]  freq    The operating frequency
  */
 void SUBGRF_CalibrateImage( uint32_t freq );
 
+/*!
+ * \brief Gets the image calibration counters
+ *
+ * \param [out] stats   Counters
+ */
+void SUBGRF_GetImageCalibrationStats( SubgRfImageCalibrationStats_t *stats );
+
 /*!
  * \brief Activate the extension of the timeout when long preamble is used
  *
@@ -1199,6 +1226,19 @@ uint8_t SUBGRF_SetRfTxPower(  int8_t power );
  */
 uint32_t SUBGRF_GetRadioWakeUpTime( void );
 
+/*!
+ * \brief Forgets the configuration shadow, the next configuration writes all
+ *        reach the radio. Needed whenever the radio may have lost its state
+ *        behind the driver, the driver already does it on init and cold sleep.
+ */
+void SUBGRF_InvalidateShadow( void );
+
+/*!
+ * \brief Gets the counters of the configuration writes skipped by the shadow
+ * \param [out] stats         Counters
+ */
+void SUBGRF_GetShadowStats( SubgRfShadowStats_t *stats );
+
 #ifdef __cplusplus
 }
 #endif
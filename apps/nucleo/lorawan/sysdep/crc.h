@@ -0,0 +1,33 @@
+/**
+ * Copyright (c) 2021 Skyarm Technologies
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef __CRC_H__
+#define __CRC_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/*
+ * 1 selects the 512 bytes table processing a byte per lookup, 0 the 32 bytes
+ * table processing a nibble per lookup.
+ */
+#ifndef CRC16_CCITT_BYTE_TABLE
+#define CRC16_CCITT_BYTE_TABLE 0
+#endif
+
+/*
+ * CRC-16/CCITT, polynomial 0x1021, MSB first, no final xor. A seed of 0
+ * gives the LoRaWAN beacon CRC, 0xFFFF the CCITT-FALSE one. The result can
+ * be passed back as the seed to continue over more data.
+ */
+uint16_t Crc16Ccitt(uint16_t seed, const uint8_t *data, uint16_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CRC_H__ */
@@ -11,6 +11,17 @@ static uint32_t rtc_clock_backup[2];
 
 extern void TimerIrqHandler(void);
 
+#ifdef CONFIG_STM32_RTC_TIMER_ALARM_B
+void RtcStopAlarm(void)
+{
+	stm32_rtc_timer_stop_alarm_b();
+}
+
+void RtcSetAlarm(uint32_t timeout)
+{
+	stm32_rtc_timer_set_alarm_b(stm32_rtc_timer_get_counter() + timeout, TimerIrqHandler);
+}
+#else /* CONFIG_STM32_RTC_TIMER_ALARM_B */
 static void rtc_clock_callback(struct k_timer *timer)
 {
 	ARG_UNUSED(timer);
@@ -28,6 +39,7 @@ void RtcSetAlarm(uint32_t timeout)
 {
 	k_timer_start(&rtc_clock_timer, K_MSEC(timeout), K_NO_WAIT);
 }
+#endif /* CONFIG_STM32_RTC_TIMER_ALARM_B */
 
 void RtcBkupWrite(uint32_t second, uint32_t subsecond)
 {
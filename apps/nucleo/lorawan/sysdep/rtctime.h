@@ -13,6 +13,10 @@ extern "C" {
 #include <stdint.h>
 #include <zephyr.h>
 
+#ifdef CONFIG_STM32_RTC_TIMER_ALARM_B
+#include <stm32_rtc_timer.h>
+#endif
+
 void RtcBkupWrite(uint32_t data0, uint32_t data1);
 
 void RtcBkupRead(uint32_t *data0, uint32_t *data1);
@@ -32,29 +36,55 @@ static inline uint32_t RtcGetCalendarTime(uint16_t *msec)
 	return (uint32_t)(ticks / 1000);
 }
 
+#ifdef CONFIG_STM32_RTC_TIMER_ALARM_B
+/*
+ * The LoRaMAC timers run on RTC alarm B, in RTC subsecond ticks counted
+ * from kernel tick 0, so they share their time base with k_uptime.
+ */
 static inline uint32_t RtcGetTimerValue(void)
 {
-	return k_uptime_get_32();
+	return stm32_rtc_timer_get_counter();
 }
 
 static inline uint32_t RtcGetMinimumTimeout(void)
 {
-	return 3;
+	return STM32_RTC_TIMER_MINIMUM_TICKS;
 }
 
-static inline void DelayMsMcu(uint32_t ms)
+static inline uint32_t RtcMs2Tick(uint32_t ms)
 {
-	k_sleep(K_MSEC(ms));
+	return (uint32_t)(((uint64_t)ms * STM32_RTC_TIMER_TICKS_PER_SEC) / 1000);
+}
+#else /* CONFIG_STM32_RTC_TIMER_ALARM_B */
+static inline uint32_t RtcGetTimerValue(void)
+{
+	return k_uptime_get_32();
+}
+
+static inline uint32_t RtcGetMinimumTimeout(void)
+{
+	return 3;
 }
 
 static inline uint32_t RtcMs2Tick(uint32_t ms)
 {
 	return ms;
 }
+#endif /* CONFIG_STM32_RTC_TIMER_ALARM_B */
 
-static inline uint32_t RtcTick2Ms(uint32_t ticks)
+/*
+ * Milliseconds since boot, on the same base as SysTimeGetMcuTime() so
+ * TimerTime_t values and SysTimeToMs() results can be mixed. It wraps at
+ * UINT32_MAX ms rather than at UINT32_MAX timer ticks.
+ */
+static inline uint32_t RtcGetTimerMs(void)
 {
-	return ticks;
+	return k_uptime_get_32();
+}
+
+static inline void DelayMsMcu(uint32_t ms)
+{
+	k_sleep(K_MSEC(ms));
 }
 
 #ifdef __cplusplus
@@ -20,6 +20,8 @@
  *
  * \author    Gregory Cristian ( Semtech )
  */
+#include <assert.h>
+
 #include "timer.h"
 
 #include "rtctime.h"
@@ -37,49 +39,76 @@
 		}			     \
 	} while (0);
 
-static uint32_t TimerBackupValue = 0;
 /*!
- * Timers list head pointer
+ * Timers queue, a binary min-heap ordered by absolute expiry time.
+ * TimerQueue[0] always contains the next timer to expire.
+ */
+static TimerEvent_t *TimerQueue[TIMER_QUEUE_SIZE];
+
+/*!
+ * Number of running timers in the queue
  */
-static TimerEvent_t *TimerListHead = NULL;
+static uint8_t TimerQueueCount = 0;
 
 /*!
- * \brief Adds or replace the head timer of the list.
+ * Timer object the RTC alarm is currently programmed for
+ */
+static TimerEvent_t *TimerArmed = NULL;
+
+/*!
+ * \brief Compares two absolute tick values
  *
- * \remark The list is automatically sorted. The list head always contains the
- *         next timer to expire.
+ * \remark The comparison is wrap safe as long as both values are less than
+ *         2^31 ticks apart.
  *
- * \param [IN]  obj Timer object to be become the new head
- * \param [IN]  remainingTime Remaining time of the previous head to be replaced
+ * \retval true if a expires before b
+ */
+static inline bool TimerIsBefore(uint32_t a, uint32_t b)
+{
+	return (int32_t)(a - b) < 0;
+}
+
+/*!
+ * \brief Stores a timer object at the given position of the queue
  */
-static void TimerInsertNewHeadTimer(TimerEvent_t *obj);
+static inline void TimerQueuePlace(TimerEvent_t *obj, uint8_t index)
+{
+	TimerQueue[index] = obj;
+	obj->HeapIndex = index;
+}
 
 /*!
- * \brief Adds a timer to the list.
- *
- * \remark The list is automatically sorted. The list head always contains the
- *         next timer to expire.
+ * \brief Moves the timer at the given position towards the queue head
+ *        until the heap order is restored.
+ */
+static void TimerQueueSiftUp(uint8_t index);
+
+/*!
+ * \brief Moves the timer at the given position towards the queue tail
+ *        until the heap order is restored.
+ */
+static void TimerQueueSiftDown(uint8_t index);
+
+/*!
+ * \brief Adds a timer to the queue.
  *
- * \param [IN]  obj Timer object to be added to the list
- * \param [IN]  remainingTime Remaining time of the running head after which the
- * object may be added
+ * \param [IN]  obj Timer object to be added to the queue
  */
-static void TimerInsertTimer(TimerEvent_t *obj);
+static void TimerQueueInsert(TimerEvent_t *obj);
 
 /*!
- * \brief Sets a timeout with the duration "timestamp"
+ * \brief Removes a timer from the queue.
  *
- * \param [IN] timestamp Delay duration
+ * \param [IN]  obj Timer object to be removed from the queue
  */
-static void TimerSetTimeout(TimerEvent_t *obj);
+static void TimerQueueRemove(TimerEvent_t *obj);
 
 /*!
- * \brief Check if the Object to be added is not already in the list
+ * \brief Programs the RTC alarm for the expiry time of a timer
  *
- * \param [IN] timestamp Delay duration
- * \retval true (the object is already in the list) or false
+ * \param [IN] obj Timer object to be armed
  */
-static bool TimerExists(TimerEvent_t *obj);
+static void TimerSetTimeout(TimerEvent_t *obj);
 
 void TimerInit(TimerEvent_t *obj, void (*callback)(void *context))
 {
@@ -87,9 +116,9 @@ void TimerInit(TimerEvent_t *obj, void (*callback)(void *context))
 	obj->ReloadValue = 0;
 	obj->IsStarted = false;
 	obj->IsNext2Expire = false;
+	obj->HeapIndex = 0;
 	obj->Callback = callback;
 	obj->Context = NULL;
-	obj->Next = NULL;
 }
 
 void TimerSetContext(TimerEvent_t *obj, void *context)
@@ -101,57 +130,92 @@ void TimerStart(TimerEvent_t *obj)
 {
 	CRITICAL_SECTION_BEGIN();
 
-	if ((obj == NULL) || (TimerExists(obj) == true)) {
+	if ((obj == NULL) || (obj->IsStarted == true)) {
 		CRITICAL_SECTION_END();
 		return;
 	}
 
-	obj->Timestamp = obj->ReloadValue;
+	if (TimerQueueCount >= TIMER_QUEUE_SIZE) {
+		/* Increase TIMER_QUEUE_SIZE */
+		assert(0);
+		CRITICAL_SECTION_END();
+		return;
+	}
+
+	obj->Timestamp = RtcGetTimerValue() + obj->ReloadValue;
 	obj->IsStarted = true;
 	obj->IsNext2Expire = false;
 
-	if (TimerListHead == NULL) {
-		TimerInsertNewHeadTimer(obj);
-	} else {
-		if (obj->Timestamp < TimerListHead->Timestamp) {
-			TimerInsertNewHeadTimer(obj);
-		} else {
-			TimerInsertTimer(obj);
-		}
+	TimerQueueInsert(obj);
+
+	if (TimerQueue[0] == obj) {
+		TimerSetTimeout(obj);
 	}
 	CRITICAL_SECTION_END();
 }
 
-static void TimerInsertTimer(TimerEvent_t *obj)
+static void TimerQueueSiftUp(uint8_t index)
 {
-	TimerEvent_t *cur = TimerListHead;
-	TimerEvent_t *next = TimerListHead->Next;
+	TimerEvent_t *obj = TimerQueue[index];
 
-	while (cur->Next != NULL) {
-		if (obj->Timestamp > next->Timestamp) {
-			cur = next;
-			next = next->Next;
-		} else {
-			cur->Next = obj;
-			obj->Next = next;
-			return;
+	while (index > 0) {
+		uint8_t parent = (index - 1) / 2;
+
+		if (TimerIsBefore(obj->Timestamp, TimerQueue[parent]->Timestamp) == false) {
+			break;
 		}
+		TimerQueuePlace(TimerQueue[parent], index);
+		index = parent;
 	}
-	cur->Next = obj;
-	obj->Next = NULL;
+	TimerQueuePlace(obj, index);
 }
 
-static void TimerInsertNewHeadTimer(TimerEvent_t *obj)
+static void TimerQueueSiftDown(uint8_t index)
 {
-	TimerEvent_t *cur = TimerListHead;
+	TimerEvent_t *obj = TimerQueue[index];
+
+	for (;;) {
+		uint8_t child = 2 * index + 1;
 
-	if (cur != NULL) {
-		cur->IsNext2Expire = false;
+		if (child >= TimerQueueCount) {
+			break;
+		}
+		if ((child + 1 < TimerQueueCount) &&
+		    TimerIsBefore(TimerQueue[child + 1]->Timestamp, TimerQueue[child]->Timestamp)) {
+			child++;
+		}
+		if (TimerIsBefore(TimerQueue[child]->Timestamp, obj->Timestamp) == false) {
+			break;
+		}
+		TimerQueuePlace(TimerQueue[child], index);
+		index = child;
 	}
+	TimerQueuePlace(obj, index);
+}
 
-	obj->Next = cur;
-	TimerListHead = obj;
-	TimerSetTimeout(TimerListHead);
+static void TimerQueueInsert(TimerEvent_t *obj)
+{
+	TimerQueuePlace(obj, TimerQueueCount++);
+	TimerQueueSiftUp(obj->HeapIndex);
+}
+
+static void TimerQueueRemove(TimerEvent_t *obj)
+{
+	uint8_t index = obj->HeapIndex;
+	TimerEvent_t *last = TimerQueue[--TimerQueueCount];
+
+	TimerQueue[TimerQueueCount] = NULL;
+	if (last != obj) {
+		TimerQueuePlace(last, index);
+		TimerQueueSiftDown(index);
+		TimerQueueSiftUp(last->HeapIndex);
+	}
+
+	if (obj == TimerArmed) {
+		TimerArmed = NULL;
+	}
+	obj->IsStarted = false;
+	obj->IsNext2Expire = false;
 }
 
 bool TimerIsStarted(TimerEvent_t *obj)
@@ -162,44 +226,25 @@ bool TimerIsStarted(TimerEvent_t *obj)
 void TimerIrqHandler(void)
 {
 	TimerEvent_t *cur;
-	TimerEvent_t *next;
-
-	uint32_t old = TimerBackupValue;
-	uint32_t now = RtcGetTimerValue();
-	uint32_t deltaContext = now - old; // intentional wrap around
-
-	// Update timeStamp based upon new Time Reference
-	// because delta context should never exceed 2^32
-	if (TimerListHead != NULL) {
-		for (cur = TimerListHead; cur->Next != NULL; cur = cur->Next) {
-			next = cur->Next;
-			if (next->Timestamp > deltaContext) {
-				next->Timestamp -= deltaContext;
-			} else {
-				next->Timestamp = 0;
-			}
-		}
-	}
 
 	// Execute immediately the alarm callback
-	if (TimerListHead != NULL) {
-		cur = TimerListHead;
-		TimerListHead = TimerListHead->Next;
-		cur->IsStarted = false;
+	if ((TimerQueueCount > 0) && (TimerQueue[0]->IsNext2Expire == true)) {
+		cur = TimerQueue[0];
+		TimerQueueRemove(cur);
 		ExecuteCallBack(cur->Callback, cur->Context);
 	}
 
-	// Remove all the expired object from the list
-	while ((TimerListHead != NULL) && (TimerListHead->Timestamp == 0)) {
-		cur = TimerListHead;
-		TimerListHead = TimerListHead->Next;
-		cur->IsStarted = false;
+	// Remove all the expired object from the queue
+	while ((TimerQueueCount > 0) &&
+	       (TimerIsBefore(RtcGetTimerValue(), TimerQueue[0]->Timestamp) == false)) {
+		cur = TimerQueue[0];
+		TimerQueueRemove(cur);
 		ExecuteCallBack(cur->Callback, cur->Context);
 	}
 
-	// Start the next TimerListHead if it exists AND NOT running
-	if ((TimerListHead != NULL) && (TimerListHead->IsNext2Expire == false)) {
-		TimerSetTimeout(TimerListHead);
+	// Start the next queue head if it exists AND NOT running
+	if ((TimerQueueCount > 0) && (TimerQueue[0]->IsNext2Expire == false)) {
+		TimerSetTimeout(TimerQueue[0]);
 	}
 }
 
@@ -207,65 +252,24 @@ void TimerStop(TimerEvent_t *obj)
 {
 	CRITICAL_SECTION_BEGIN();
 
-	TimerEvent_t *prev = TimerListHead;
-	TimerEvent_t *cur = TimerListHead;
-
-	// List is empty or the obj to stop does not exist
-	if ((TimerListHead == NULL) || (obj == NULL)) {
+	// Queue is empty or the obj to stop is not running
+	if ((obj == NULL) || (obj->IsStarted == false)) {
 		CRITICAL_SECTION_END();
 		return;
 	}
 
-	obj->IsStarted = false;
+	bool wasArmed = obj->IsNext2Expire;
 
-	if (TimerListHead == obj) {                             // Stop the Head
-		if (TimerListHead->IsNext2Expire == true) {     // The head is already running
-			TimerListHead->IsNext2Expire = false;
-			if (TimerListHead->Next != NULL) {
-				TimerListHead = TimerListHead->Next;
-				TimerSetTimeout(TimerListHead);
-			} else {
-				RtcStopAlarm();
-				TimerListHead = NULL;
-			}
-		} else { // Stop the head before it is started
-			if (TimerListHead->Next != NULL) {
-				TimerListHead = TimerListHead->Next;
-			} else {
-				TimerListHead = NULL;
-			}
-		}
-	} else { // Stop an object within the list
-		while (cur != NULL) {
-			if (cur == obj) {
-				if (cur->Next != NULL) {
-					cur = cur->Next;
-					prev->Next = cur;
-				} else {
-					cur = NULL;
-					prev->Next = cur;
-				}
-				break;
-			} else {
-				prev = cur;
-				cur = cur->Next;
-			}
-		}
-	}
-	CRITICAL_SECTION_END();
-}
-
-static bool TimerExists(TimerEvent_t *obj)
-{
-	TimerEvent_t *cur = TimerListHead;
+	TimerQueueRemove(obj);
 
-	while (cur != NULL) {
-		if (cur == obj) {
-			return true;
+	if (wasArmed == true) { // The alarm is running for this object
+		if (TimerQueueCount > 0) {
+			TimerSetTimeout(TimerQueue[0]);
+		} else {
+			RtcStopAlarm();
 		}
-		cur = cur->Next;
 	}
-	return false;
+	CRITICAL_SECTION_END();
 }
 
 void TimerReset(TimerEvent_t *obj)
@@ -287,15 +291,12 @@ void TimerSetValue(TimerEvent_t *obj, uint32_t value)
 		ticks = minValue;
 	}
 
-	obj->Timestamp = ticks;
 	obj->ReloadValue = ticks;
 }
 
 TimerTime_t TimerGetCurrentTime(void)
 {
-	uint32_t now = RtcGetTimerValue();
-
-	return RtcTick2Ms(now);
+	return RtcGetTimerMs();
 }
 
 TimerTime_t TimerGetElapsedTime(TimerTime_t past)
@@ -303,24 +304,26 @@ TimerTime_t TimerGetElapsedTime(TimerTime_t past)
 	if (past == 0) {
 		return 0;
 	}
-	uint32_t nowInTicks = RtcGetTimerValue();
-	uint32_t pastInTicks = RtcMs2Tick(past);
 
-	// Intentional wrap around. Works Ok if tick duration below 1ms
-	return RtcTick2Ms(nowInTicks - pastInTicks);
+	// Intentional wrap around
+	return RtcGetTimerMs() - past;
 }
 
 static void TimerSetTimeout(TimerEvent_t *obj)
 {
-	int32_t minTicks = RtcGetMinimumTimeout();
+	uint32_t minTicks = RtcGetMinimumTimeout();
+	uint32_t remaining = obj->Timestamp - RtcGetTimerValue();
 
+	if (TimerArmed != NULL) {
+		TimerArmed->IsNext2Expire = false;
+	}
+	TimerArmed = obj;
 	obj->IsNext2Expire = true;
 
-	// In case deadline too soon
-	if (obj->Timestamp < minTicks) {
-		obj->Timestamp = minTicks;
+	// In case deadline too soon or already elapsed
+	if (((int32_t)remaining < 0) || (remaining < minTicks)) {
+		remaining = minTicks;
 	}
 
-	TimerBackupValue = RtcGetTimerValue();
-	RtcSetAlarm(obj->Timestamp);
+	RtcSetAlarm(remaining);
 }
@@ -31,18 +31,30 @@ extern "C"
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+
+/*!
+ * \brief Maximum number of timers which can be running at the same time
+ *
+ * \remark The timer queue is a binary min-heap stored in a static array, so
+ *         this bounds the RAM used by the queue, not the number of
+ *         TimerEvent_t objects which may exist.
+ */
+#ifndef TIMER_QUEUE_SIZE
+#define TIMER_QUEUE_SIZE 16
+#endif
+
   /*
    * \brief Timer object description
    */
   typedef struct TimerEvent_s
   {
-    uint32_t Timestamp;              //! Current timer value
+    uint32_t Timestamp;              //! Absolute expiry time in ticks
     uint32_t ReloadValue;            //! Timer delay value
     bool IsStarted;                  //! Is the timer currently running
     bool IsNext2Expire;              //! Is the next timer to expire
+    uint8_t HeapIndex;               //! Position in the timer queue
     void (*Callback)(void* context); //! Timer IRQ callback function
     void* Context;             //! User defined data object pointer to pass back
-    struct TimerEvent_s* Next; //! Pointer to the next Timer object.
   } TimerEvent_t;
 
 /*!
@@ -81,6 +93,8 @@ extern "C"
   /*!
    * \brief Starts and adds the timer object to the list of timer events
    *
+   * \remark Starting a timer which is already running has no effect.
+   *
    * \param [IN] obj Structure containing the timer object parameters
    */
   void TimerStart(TimerEvent_t* obj);
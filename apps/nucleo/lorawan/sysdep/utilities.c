@@ -31,38 +31,159 @@
  ******************************************************************************
  */
 
+#include <string.h>
 #include <stm32wlxx_hal.h>
 
 #include "utilities.h"
 
+/*
+ * The copies below move a word, or a halfword, at a time where the buffers
+ * allow it and fall back to the byte loop otherwise. The cores with
+ * unaligned access support (M4) only need aligned stores, the others (M0+)
+ * need both pointers aligned alike.
+ */
+#define MEM_IS_ALIGNED(p, n) (((uintptr_t)(p) & ((n) - 1)) == 0)
+
+#if defined(__ARM_FEATURE_UNALIGNED)
+static inline uint32_t mem_load32(const uint8_t *src)
+{
+	uint32_t w;
+
+	/* a single ldr, whatever the alignment */
+	memcpy(&w, src, sizeof(w));
+	return w;
+}
+
+static inline void mem_store32(uint8_t *dst, uint32_t w)
+{
+	memcpy(dst, &w, sizeof(w));
+}
+#else
+/* Only called on word aligned pointers */
+static inline uint32_t mem_load32(const uint8_t *src)
+{
+	return *(const uint32_t *)src;
+}
+
+static inline void mem_store32(uint8_t *dst, uint32_t w)
+{
+	*(uint32_t *)dst = w;
+}
+#endif
+
 /*!
  * Redefinition of rand() and srand() standard C functions.
  * These functions are redefined in order to get the same behavior across
  * different compiler toolchains implementations.
+ *
+ * The generator is xoshiro128**, 32-bit operations only so it stays cheap on
+ * the M0+, and bounded draws use a multiply-shift instead of a modulo.
  */
 // Standard random functions redefinition start
-#define RAND_LOCAL_MAX 2147483647L
+static uint32_t rand_state[4] = { 0x9E3779B9, 0x243F6A88, 0xB7E15162, 0x6A09E667 };
 
-static uint32_t next = 1;
+static inline uint32_t rand_rotl(uint32_t x, int k)
+{
+	return (x << k) | (x >> (32 - k));
+}
 
-static int32_t rand1(void)
+static uint32_t rand1(void)
 {
-	return ((next = next * 1103515245L + 12345L) % RAND_LOCAL_MAX);
+	uint32_t *s = rand_state;
+	uint32_t result = rand_rotl(s[1] * 5, 7) * 9;
+	uint32_t t = s[1] << 9;
+
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = rand_rotl(s[3], 11);
+
+	return result;
 }
 
 void srand1(uint32_t seed)
 {
-	next = seed;
+	/* spread the seed over the whole state, splitmix32 never yields all zeros */
+	for (int i = 0; i < 4; i++) {
+		uint32_t z = (seed += 0x9E3779B9);
+
+		z = (z ^ (z >> 16)) * 0x85EBCA6B;
+		z = (z ^ (z >> 13)) * 0xC2B2AE35;
+		rand_state[i] = z ^ (z >> 16);
+	}
 }
 // Standard random functions redefinition end
 
 int32_t randr(int32_t min, int32_t max)
 {
-	return (int32_t)rand1() % (max - min + 1) + min;
+	uint32_t range = (uint32_t)max - (uint32_t)min + 1;
+	uint64_t m;
+
+	if (range == 0) {
+		/* min..max spans all 32-bit values */
+		return (int32_t)rand1();
+	}
+
+	/*
+	 * Lemire's bounded draw: the high word of x * range is uniform once the
+	 * few low words below 2^32 % range are rejected. The modulo is only
+	 * computed when a draw falls in the first range values.
+	 */
+	m = (uint64_t)rand1() * range;
+	if ((uint32_t)m < range) {
+		uint32_t threshold = -range % range;
+
+		while ((uint32_t)m < threshold) {
+			m = (uint64_t)rand1() * range;
+		}
+	}
+
+	return (int32_t)((uint32_t)min + (uint32_t)(m >> 32));
 }
 
 void memcpy1(uint8_t *dst, const uint8_t *src, uint16_t size)
 {
+	/*
+	 * Callers rely on the forward byte order when dst overlaps the end of
+	 * src. Moving words keeps it as long as a load never reads a byte not
+	 * stored yet, that is unless dst is 1 to 3 bytes past src.
+	 */
+	if ((uintptr_t)dst - (uintptr_t)src >= sizeof(uint32_t)) {
+#if defined(__ARM_FEATURE_UNALIGNED)
+		bool words = true;
+#else
+		bool words = MEM_IS_ALIGNED((uintptr_t)dst ^ (uintptr_t)src, 4);
+
+		if (!words && MEM_IS_ALIGNED((uintptr_t)dst ^ (uintptr_t)src, 2)) {
+			if (!MEM_IS_ALIGNED(dst, 2) && (size > 0)) {
+				*dst++ = *src++;
+				size--;
+			}
+			for (; size >= 4; size -= 4, dst += 4, src += 4) {
+				((uint16_t *)dst)[0] = ((const uint16_t *)src)[0];
+				((uint16_t *)dst)[1] = ((const uint16_t *)src)[1];
+			}
+		}
+#endif
+		if (words) {
+			while (!MEM_IS_ALIGNED(dst, 4) && (size > 0)) {
+				*dst++ = *src++;
+				size--;
+			}
+			for (; size >= 16; size -= 16, dst += 16, src += 16) {
+				mem_store32(dst, mem_load32(src));
+				mem_store32(dst + 4, mem_load32(src + 4));
+				mem_store32(dst + 8, mem_load32(src + 8));
+				mem_store32(dst + 12, mem_load32(src + 12));
+			}
+			for (; size >= 4; size -= 4, dst += 4, src += 4) {
+				mem_store32(dst, mem_load32(src));
+			}
+		}
+	}
+
 	while (size--) {
 		*dst++ = *src++;
 	}
@@ -70,6 +191,18 @@ void memcpy1(uint8_t *dst, const uint8_t *src, uint16_t size)
 
 void memcpyr(uint8_t *dst, const uint8_t *src, uint16_t size)
 {
+	/* Reversing words keeps the result only when the buffers are disjoint */
+	if (((uintptr_t)dst + size <= (uintptr_t)src) || ((uintptr_t)src + size <= (uintptr_t)dst)) {
+#if !defined(__ARM_FEATURE_UNALIGNED)
+		if (MEM_IS_ALIGNED(src, 4) && MEM_IS_ALIGNED(dst + size, 4))
+#endif
+		{
+			for (; size >= 4; size -= 4, src += 4) {
+				mem_store32(dst + size - 4, __builtin_bswap32(mem_load32(src)));
+			}
+		}
+	}
+
 	dst = dst + (size - 1);
 	while (size--) {
 		*dst-- = *src++;
@@ -78,6 +211,22 @@ void memcpyr(uint8_t *dst, const uint8_t *src, uint16_t size)
 
 void memset1(uint8_t *dst, uint8_t value, uint16_t size)
 {
+	uint32_t w = value * 0x01010101UL;
+
+	while (!MEM_IS_ALIGNED(dst, 4) && (size > 0)) {
+		*dst++ = value;
+		size--;
+	}
+	for (; size >= 16; size -= 16, dst += 16) {
+		mem_store32(dst, w);
+		mem_store32(dst + 4, w);
+		mem_store32(dst + 8, w);
+		mem_store32(dst + 12, w);
+	}
+	for (; size >= 4; size -= 4, dst += 4) {
+		mem_store32(dst, w);
+	}
+
 	while (size--) {
 		*dst++ = value;
 	}
@@ -96,32 +245,17 @@ int8_t Nibble2HexChar(uint8_t a)
 
 void UTIL_MEM_cpy_8(void *dst, const void *src, uint16_t size)
 {
-	uint8_t *dst8 = (uint8_t *)dst;
-	uint8_t *src8 = (uint8_t *)src;
-
-	while (size--) {
-		*dst8++ = *src8++;
-	}
+	memcpy1((uint8_t *)dst, (const uint8_t *)src, size);
 }
 
 void UTIL_MEM_cpyr_8(void *dst, const void *src, uint16_t size)
 {
-	uint8_t *dst8 = (uint8_t *)dst;
-	uint8_t *src8 = (uint8_t *)src;
-
-	dst8 = dst8 + (size - 1);
-	while (size--) {
-		*dst8-- = *src8++;
-	}
+	memcpyr((uint8_t *)dst, (const uint8_t *)src, size);
 }
 
 void UTIL_MEM_set_8(void *dst, uint8_t value, uint16_t size)
 {
-	uint8_t *dst8 = (uint8_t *)dst;
-
-	while (size--) {
-		*dst8++ = value;
-	}
+	memset1((uint8_t *)dst, value, size);
 }
 
 uint32_t GetDevAddr(void)
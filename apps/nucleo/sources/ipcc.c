@@ -13,6 +13,8 @@
 #include <lorawan_node.h>
 
 #define IPM_CHANNEL_ID 0
+/* retry interval of the requests the mac could not serve yet */
+#define IPM_RETRY_INTERVAL K_MSEC(1000)
 static const struct device *ipm_device = NULL;
 static uint8_t ipm_buffer[255];
 
@@ -52,6 +54,8 @@ struct ipm_request {
 	};
 };
 
+static void ipm_request_retry(void);
+
 void ipcc_rpt_join_request(const struct lorawan_node_join_callback_params *params)
 {
     uint8_t status = params->status == LORAWAN_NODE_EVENT_STATUS_OK ? 0 : 1;
@@ -59,10 +63,13 @@ void ipcc_rpt_join_request(const struct lorawan_node_join_callback_params *param
 	ipm_buffer[0] = (uint8_t)ipm_rpt_join_request;
 	ipm_buffer[1] = status;
 	ipm_send(ipm_device, 0, IPM_CHANNEL_ID, ipm_buffer, 2);
+	ipm_request_retry();
 }
 
 void ipcc_rpt_data_sent(const struct lorawan_node_cb_data_sent_params *params)
-{	
+{
+	/* the mac may be free again */
+	ipm_request_retry();
 }
 
 void ipcc_rpt_data_received(uint8_t port, const void *data, uint8_t size,
@@ -82,6 +89,51 @@ void ipcc_rpt_class_changed(enum lorawan_node_class new_class)
 	ipm_buffer[0] = (uint8_t)ipm_rpt_class_changed;
 	ipm_buffer[1] = new_class;
 	ipm_send(ipm_device, 0, IPM_CHANNEL_ID, ipm_buffer, 2);
+	ipm_request_retry();
+}
+
+static bool cmd_get_datetime();
+static bool cmd_send_message();
+static bool cmd_change_class();
+static bool cmd_current_class();
+
+static bool ipm_request_pending(void)
+{
+	return ipm_request.get_datetime || ipm_request.send_message ||
+	       ipm_request.change_class || ipm_request.current_class;
+}
+
+/* LoRaMac isn't reentrant, the requests are served on the lorawan_node work queue */
+static void ipm_work_handler(struct k_work *work)
+{
+	struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+
+	if (ipm_request.get_datetime) {
+		cmd_get_datetime();
+	}
+	if (ipm_request.send_message) {
+		cmd_send_message();
+	}
+	if (ipm_request.change_class) {
+		cmd_change_class();
+	}
+	if (ipm_request.current_class) {
+		cmd_current_class();
+	}
+
+	/* the mac was busy or switching to Class B, a mac confirm or the timeout retries */
+	if (ipm_request_pending()) {
+		lorawan_node_schedule(dwork, IPM_RETRY_INTERVAL);
+	}
+}
+
+static K_WORK_DELAYABLE_DEFINE(ipm_work, ipm_work_handler);
+
+static void ipm_request_retry(void)
+{
+	if (ipm_request_pending()) {
+		lorawan_node_schedule(&ipm_work, K_NO_WAIT);
+	}
 }
 
 static void cb_ipm(const struct device *device, void *user_data,
@@ -96,7 +148,7 @@ static void cb_ipm(const struct device *device, void *user_data,
 	case ipm_cmd_get_datetime:
 	{
 		ipm_request.get_datetime = true;
-		k_sem_give(&sem_mac_process);
+		lorawan_node_schedule(&ipm_work, K_NO_WAIT);
 	}
 	break;
 	case ipm_cmd_send_message:
@@ -106,20 +158,20 @@ static void cb_ipm(const struct device *device, void *user_data,
 		ipm_request.message.size = p[3];
 		memcpy(ipm_request.message.data, p + 4,  ipm_request.message.size);
 		ipm_request.send_message = true;
-		k_sem_give(&sem_mac_process);
+		lorawan_node_schedule(&ipm_work, K_NO_WAIT);
 	}
 	break;
 	case ipm_cmd_change_class:
 	{
 		ipm_request.new_class = p[1];
 		ipm_request.change_class = true;
-		k_sem_give(&sem_mac_process);
+		lorawan_node_schedule(&ipm_work, K_NO_WAIT);
 	}
 	break;
 	case ipm_cmd_current_class:
 	{
 		ipm_request.current_class = true;
-		k_sem_give(&sem_mac_process);
+		lorawan_node_schedule(&ipm_work, K_NO_WAIT);
 	}
 	break;
 	default:
@@ -187,12 +239,16 @@ static bool cmd_current_class()
 
 static bool cmd_send_message()
 {
-	if (lorawan_node_is_busy() || lorawan_node_classb_pending()) {
-		/* device is busy or not joined or is switching to Class B*/
+	struct lorawan_node_send_params params = {
+		.port = ipm_request.message.port,
+		.tx_confirmed = ipm_request.message.confirmed,
+	};
+
+	/* the uplink queue waits for the join, the mac and the duty cycle */
+	if (lorawan_node_send_queued(&params, ipm_request.message.data,
+				     ipm_request.message.size) != LORAWAN_NODE_STATUS_OK) {
 		return false;
 	}
-	lorawan_node_send(ipm_request.message.port, ipm_request.message.data,
-			  ipm_request.message.size, ipm_request.message.confirmed, true);
 	ipm_request.send_message = false;
 	return true;
 }
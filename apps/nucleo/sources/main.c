@@ -20,7 +20,6 @@ static void cb_join_request(const struct lorawan_node_cb_join_request_params *pa
 static void cb_data_sent(const struct lorawan_node_cb_data_sent_params *params);
 static void cb_data_received(uint8_t port, const void *data, uint8_t size,
 			     const struct lorawan_node_cb_data_received_params  *params);
-static void cb_mac_process(void);
 static void cb_class_changed(enum lorawan_node_class new_class);
 static void cb_beacon_status(const struct lorawan_node_cb_beacon_status_params *params);
 static void cb_device_time(uint32_t seconds, uint16_t subseconds);
@@ -35,7 +34,6 @@ static const struct lorawan_node_config node_config = {
 	.ping_periodicity = 6,
 	.callbacks.get_battery_level = cb_get_battery_level,
 	.callbacks.get_temperature = cb_get_temperature,
-	.callbacks.mac_process = cb_mac_process,
 	.callbacks.join_request = cb_join_request,
 	.callbacks.data_sent = cb_data_sent,
 	.callbacks.data_received = cb_data_received,
@@ -87,18 +85,15 @@ static void cb_data_received(uint8_t port, const void *data, uint8_t size,
 	       size, params->status, params->data_rate, params->rssi, params->snr);
 }
 
-K_SEM_DEFINE(sem_mac_process, 0, 1);
-
-static void cb_mac_process(void)
-{
-	k_sem_give(&sem_mac_process);
-}
-
 static void cb_class_changed(enum lorawan_node_class new_class)
 {
 	if (new_class == LORAWAN_NODE_CLASS_B) {
+		static const struct lorawan_node_send_params params = {
+			.port = 1,
+			.tx_confirmed = false,
+		};
 		char *p = "I'm on CLASS B";
-		lorawan_node_send(1, (const uint8_t *)p, (uint8_t)strlen(p), false, true);
+		lorawan_node_send_queued(&params, (const uint8_t *)p, (uint8_t)strlen(p));
 	}
 	printk("Class has been changed to CLASS %c.\n", "ABC"[new_class]);
 }
@@ -113,6 +108,17 @@ static void cb_device_time(uint32_t seconds, uint16_t subseconds)
 {
 }
 
+static void join_handler(struct k_work *work)
+{
+	enum lorawan_node_status status = lorawan_node_join(LORAWAN_NODE_ACTIVATION_OTAA);
+	if (status != LORAWAN_NODE_STATUS_OK) {
+		printk("lorawan_node_join failed, return code[%d]\n", status);
+		assert(0);
+	}
+}
+
+K_WORK_DEFINE(join_work, join_handler);
+
 void main(void)
 {
 	enum lorawan_node_status status = lorawan_node_init(&node_config);
@@ -121,16 +127,10 @@ void main(void)
 		assert(0);
 	}
 
-	status = lorawan_node_join(LORAWAN_NODE_ACTIVATION_OTAA);
+	/* The mac events and the callbacks below run on the lorawan_node work queue. */
+	status = lorawan_node_submit(&join_work);
 	if (status != LORAWAN_NODE_STATUS_OK) {
-		printk("lorawan_node_join failed, return code[%d]\n", status);
+		printk("lorawan_node_submit failed, return code[%d]\n", status);
 		assert(0);
 	}
-
-	for (;;) {
-		lorawan_node_process();
-		if (k_sem_take(&sem_mac_process, K_SECONDS(1000)) == 0) {
-			continue;
-		}
-	}
 }
@@ -27,6 +27,7 @@
 #include <drivers/interrupt_controller/exti_stm32.h>
 
 #include "stm32_hsem.h"
+#include "intc_exti_stm32.h"
 
 #if defined(CONFIG_SOC_SERIES_STM32F0X) || \
     defined(CONFIG_SOC_SERIES_STM32L0X) || \
@@ -112,6 +113,11 @@ struct __exti_cb {
 struct stm32_exti_data {
 	/* per-line callbacks */
 	struct __exti_cb cb[ARRAY_SIZE(exti_irq_table)];
+	/* lines having a callback */
+	uint32_t cb_mask;
+#ifdef CONFIG_EXTI_STM32_STATS
+	struct stm32_exti_stats stats[ARRAY_SIZE(exti_irq_table)];
+#endif
 };
 
 void stm32_exti_enable(int line)
@@ -156,50 +162,42 @@ void stm32_exti_disable(int line)
 }
 
 /**
- * @brief check if interrupt is pending
+ * @brief get pending interrupts
  *
- * @param line line number
+ * @param mask lines to look at
+ * @return pending lines of mask
  */
-static inline int stm32_exti_is_pending(int line)
+static inline uint32_t stm32_exti_get_pending(uint32_t mask)
 {
-	if (line < 32) {
 #if defined(CONFIG_SOC_SERIES_STM32MP1X) || \
 	defined(CONFIG_SOC_SERIES_STM32G0X) || \
 	defined(CONFIG_SOC_SERIES_STM32L5X)
-		return (LL_EXTI_IsActiveRisingFlag_0_31(1 << line) ||
-			LL_EXTI_IsActiveFallingFlag_0_31(1 << line));
+	return LL_EXTI_ReadRisingFlag_0_31(mask) |
+	       LL_EXTI_ReadFallingFlag_0_31(mask);
 #elif defined(CONFIG_SOC_SERIES_STM32H7X) && defined(CONFIG_CPU_CORTEX_M4)
-		return LL_C2_EXTI_IsActiveFlag_0_31(1 << line);
+	return LL_C2_EXTI_ReadFlag_0_31(mask);
 #else
-		return LL_EXTI_IsActiveFlag_0_31(1 << line);
+	return LL_EXTI_ReadFlag_0_31(mask);
 #endif
-	} else {
-		__ASSERT_NO_MSG(line);
-		return 0;
-	}
 }
 
 /**
- * @brief clear pending interrupt bit
+ * @brief clear pending interrupt bits
  *
- * @param line line number
+ * @param mask lines to clear
  */
-static inline void stm32_exti_clear_pending(int line)
+static inline void stm32_exti_clear_pending(uint32_t mask)
 {
-	if (line < 32) {
 #if defined(CONFIG_SOC_SERIES_STM32MP1X) || \
 	defined(CONFIG_SOC_SERIES_STM32G0X) || \
 	defined(CONFIG_SOC_SERIES_STM32L5X)
-		LL_EXTI_ClearRisingFlag_0_31(1 << line);
-		LL_EXTI_ClearFallingFlag_0_31(1 << line);
+	LL_EXTI_ClearRisingFlag_0_31(mask);
+	LL_EXTI_ClearFallingFlag_0_31(mask);
 #elif defined(CONFIG_SOC_SERIES_STM32H7X) && defined(CONFIG_CPU_CORTEX_M4)
-		LL_C2_EXTI_ClearFlag_0_31(1 << line);
+	LL_C2_EXTI_ClearFlag_0_31(mask);
 #else
-		LL_EXTI_ClearFlag_0_31(1 << line);
+	LL_EXTI_ClearFlag_0_31(mask);
 #endif
-	} else {
-		__ASSERT_NO_MSG(line);
-	}
 }
 
 void stm32_exti_trigger(int line, int trigger)
@@ -241,27 +239,49 @@ void stm32_exti_trigger(int line, int trigger)
  *
  * @param arg isr argument
  * @param min low end of EXTI# range
- * @param max low end of EXTI# range
+ * @param max high end of EXTI# range, excluded
  */
 static void __stm32_exti_isr(int min, int max, const struct device *dev)
 {
 	struct stm32_exti_data *data = dev->data;
+	uint32_t pending;
+	stm32_exti_callback_t cb;
 	int line;
 
-	/* see which bits are set */
-	for (line = min; line < max; line++) {
-		/* check if interrupt is pending */
-		if (stm32_exti_is_pending(line)) {
-			/* clear pending interrupt */
-			stm32_exti_clear_pending(line);
+	/* see which bits are set, with a single read */
+	pending = stm32_exti_get_pending(GENMASK(max - 1, min));
+	if (!pending) {
+		return;
+	}
+
+	/* clear them all at once, lines without a callback included */
+	stm32_exti_clear_pending(pending);
 
-			/* run callback only if one is registered */
-			if (!data->cb[line].cb) {
-				continue;
-			}
+	/* run callbacks only for the lines having one */
+	pending &= data->cb_mask;
+	while (pending) {
+		line = __builtin_ctz(pending);
+		pending &= pending - 1;
 
-			data->cb[line].cb(line, data->cb[line].data);
+		cb = data->cb[line].cb;
+		if (!cb) {
+			continue;
 		}
+
+#ifdef CONFIG_EXTI_STM32_STATS
+		uint32_t start = k_cycle_get_32();
+
+		cb(line, data->cb[line].data);
+
+		start = k_cycle_get_32() - start;
+		data->stats[line].count++;
+		data->stats[line].cycles += start;
+		if (start > data->stats[line].max_cycles) {
+			data->stats[line].max_cycles = start;
+		}
+#else
+		cb(line, data->cb[line].data);
+#endif
 	}
 }
 
@@ -457,6 +477,7 @@ int stm32_exti_set_callback(int line, stm32_exti_callback_t cb, void *arg)
 
 	data->cb[line].cb = cb;
 	data->cb[line].data = arg;
+	data->cb_mask |= BIT(line);
 
 	return 0;
 }
@@ -466,10 +487,30 @@ void stm32_exti_unset_callback(int line)
 	const struct device *dev = DEVICE_DT_GET(EXTI_NODE);
 	struct stm32_exti_data *data = dev->data;
 
+	data->cb_mask &= ~BIT(line);
 	data->cb[line].cb = NULL;
 	data->cb[line].data = NULL;
 }
 
+#ifdef CONFIG_EXTI_STM32_STATS
+int stm32_exti_get_stats(int line, struct stm32_exti_stats *stats)
+{
+	const struct device *dev = DEVICE_DT_GET(EXTI_NODE);
+	struct stm32_exti_data *data = dev->data;
+	unsigned int key;
+
+	if (line < 0 || line >= ARRAY_SIZE(exti_irq_table)) {
+		return -EINVAL;
+	}
+
+	key = irq_lock();
+	*stats = data->stats[line];
+	irq_unlock(key);
+
+	return 0;
+}
+#endif
+
 /**
  * @brief connect all interrupts
  */
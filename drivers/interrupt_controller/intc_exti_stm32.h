@@ -0,0 +1,39 @@
+/**
+ * Copyright (c) 2021 Skyarm Technologies
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef ZEPHYR_DRIVERS_INTERRUPT_CONTROLLER_INTC_EXTI_STM32_H_
+#define ZEPHYR_DRIVERS_INTERRUPT_CONTROLLER_INTC_EXTI_STM32_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Per line interrupt counters
+ */
+struct stm32_exti_stats {
+	/* callbacks run */
+	uint32_t count;
+	/* cycles spent in the callback, all runs */
+	uint32_t cycles;
+	/* longest callback run, in cycles */
+	uint32_t max_cycles;
+};
+
+/**
+ * @brief Get the interrupt counters of a line
+ * @param [in] line EXTI line
+ * @param [out] stats counters
+ * @retval 0 on success, -EINVAL for an invalid line.
+ */
+int stm32_exti_get_stats(int line, struct stm32_exti_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ZEPHYR_DRIVERS_INTERRUPT_CONTROLLER_INTC_EXTI_STM32_H_ */
@@ -14,6 +14,8 @@
 #include <logging/log.h>
 #include <soc.h>
 #include <stm32_ll_ipcc.h>
+#include "ipm_stm32_ipcc2_ring.h"
+#include "ipm_stm32_ipcc2.h"
 LOG_MODULE_REGISTER(ipm_stm32_ipcc, LOG_LEVEL_INF);
 
 /* convenience defines */
@@ -26,6 +28,11 @@ LOG_MODULE_REGISTER(ipm_stm32_ipcc, LOG_LEVEL_INF);
 #define IPCC_ALL_MR_RXO_CH_MASK 0x0000FFFF
 #define IPCC_ALL_SR_CH_MASK 0x0000FFFF
 
+/* Messages travel through the shared rings, this channel only rings the bell */
+#define IPCC_RING_DOORBELL_CH 0
+
+#define IPCC_CH_COUNT 6
+
 #if (CONFIG_IPM_STM32_IPCC2_PROCID == 1)
 
 #define IPCC_EnableIT_TXF(hipcc) LL_C1_IPCC_EnableIT_TXF(hipcc)
@@ -88,109 +95,196 @@ struct stm32_ipcc_mailbox_config {
 	void (*irq_config_func)(const struct device *dev);
 	IPCC_TypeDef *ipcc;
 	struct stm32_pclken pclken;
-	void *buffer;
-	size_t buff_size;
+	struct stm32_ipcc_ring *tx_ring;
+	size_t tx_ring_size;
+	struct stm32_ipcc_ring *rx_ring;
+	size_t rx_ring_size;
 };
 
 struct stm32_ipcc_mbx_data {
 	uint32_t num_ch;
 	ipm_callback_t callback;
 	void *user_data;
+	/* serializes the producers of this core on the tx ring and the backlog */
+	struct k_spinlock tx_lock;
+	/* messages waiting for tx ring space, prefixed by their k_cycle_get_32() stamp */
+	struct stm32_ipcc_ring *backlog;
+	/* given by the tx free interrupt to the blocked senders */
+	struct k_sem tx_free;
+	ipm_stm32_ipcc2_tx_done_t tx_done;
+	void *tx_done_user_data;
+	struct ipm_stm32_ipcc2_stats stats[IPCC_CH_COUNT];
 };
 
 static struct stm32_ipcc_mbx_data stm32_IPCC_data;
 
-#ifndef CONFIG_CPU_CORTEX_M0PLUS
-static void stm32_ipcc_mailbox_rx_isr(const struct device *dev)
+static uint8_t stm32_ipcc_backlog[sizeof(struct stm32_ipcc_ring) +
+				  CONFIG_IPM_STM32_IPCC2_BACKLOG_SIZE] __aligned(4);
+
+/* Called with tx_lock held */
+static bool stm32_ipcc_mailbox_push(const struct device *dev, uint32_t id, const void *buff,
+				    uint16_t size, uint32_t since)
 {
 	struct stm32_ipcc_mbx_data *data = DEV_DATA(dev);
 	const struct stm32_ipcc_mailbox_config *cfg = DEV_CFG(dev);
-	unsigned int value = 0;
-	uint32_t mask, i;
+	struct ipm_stm32_ipcc2_stats *stats = &data->stats[id];
+	uint32_t next;
+	uint8_t *msg;
 
-	mask = (~IPCC_ReadReg(cfg->ipcc, MR)) & IPCC_ALL_MR_RXO_CH_MASK;
-	mask &= IPCC_ReadOtherInstReg_SR(cfg->ipcc) & IPCC_ALL_SR_CH_MASK;
+	msg = stm32_ipcc_ring_reserve(cfg->tx_ring, id, size, &next);
+	if (msg == NULL) {
+		return false;
+	}
 
-	for (i = 0; i < data->num_ch; i++) {
-		if (!((1 << i) & mask)) {
-			continue;
-		}
-		LOG_DBG("%s channel = %x\r\n", __func__, i);
-		/* mask the channel Free interrupt  */
-		IPCC_DisableReceiveChannel(cfg->ipcc, i);
+	memcpy(msg, buff, size);
+	/* A set flag means the other core has not taken the last bell yet, it drains anyway */
+	if (stm32_ipcc_ring_commit(cfg->tx_ring, next) &&
+	    !IPCC_IsActiveFlag_CHx(cfg->ipcc, IPCC_RING_DOORBELL_CH)) {
+		IPCC_SetFlag_CHx(cfg->ipcc, IPCC_RING_DOORBELL_CH);
+	}
+
+	stats->sent++;
+	stats->max_wait_cycles = MAX(stats->max_wait_cycles, k_cycle_get_32() - since);
+	return true;
+}
 
-		if (data->callback) {
-			/* Only one MAILBOX, id is unused and set to 0 */
-			data->callback(dev, data->user_data, i, &value);
+/* Called with tx_lock released, the callback may send again */
+static void stm32_ipcc_mailbox_tx_done(const struct device *dev, uint32_t id)
+{
+	struct stm32_ipcc_mbx_data *data = DEV_DATA(dev);
+	ipm_stm32_ipcc2_tx_done_t tx_done = data->tx_done;
+
+	if (tx_done) {
+		tx_done(dev, data->tx_done_user_data, id);
+	}
+}
+
+/*
+ * Called with tx_lock held. The tx free interrupt fires when the other core
+ * takes the bell, which is when it starts draining, so the bell is rung even
+ * over a ring it is already draining.
+ */
+static void stm32_ipcc_mailbox_wait_free(const struct device *dev)
+{
+	const struct stm32_ipcc_mailbox_config *cfg = DEV_CFG(dev);
+
+	if (!IPCC_IsActiveFlag_CHx(cfg->ipcc, IPCC_RING_DOORBELL_CH)) {
+		IPCC_SetFlag_CHx(cfg->ipcc, IPCC_RING_DOORBELL_CH);
+	}
+	IPCC_EnableTransmitChannel(cfg->ipcc, IPCC_RING_DOORBELL_CH);
+}
+
+static void stm32_ipcc_mailbox_tx(const struct device *dev, uint32_t mask)
+{
+	struct stm32_ipcc_mbx_data *data = DEV_DATA(dev);
+	const struct stm32_ipcc_mailbox_config *cfg = DEV_CFG(dev);
+	k_spinlock_key_t key;
+	uint32_t id, since;
+	uint8_t *msg;
+	uint16_t len;
+
+	if (!(mask & BIT(IPCC_RING_DOORBELL_CH))) {
+		return;
+	}
+	LOG_DBG("%s doorbell free", __func__);
+
+	/* mask the channel Free interrupt */
+	IPCC_DisableTransmitChannel(cfg->ipcc, IPCC_RING_DOORBELL_CH);
+
+	key = k_spin_lock(&data->tx_lock);
+	while (stm32_ipcc_ring_peek(data->backlog, &id, &msg, &len)) {
+		memcpy(&since, msg, sizeof(since));
+		if (!stm32_ipcc_mailbox_push(dev, id, msg + sizeof(since), len - sizeof(since),
+					     since)) {
+			break;
 		}
-		/* clear status to acknoledge message reception */
-		IPCC_ClearFlag_CHx(cfg->ipcc, i);
-		IPCC_EnableReceiveChannel(cfg->ipcc, i);
+		stm32_ipcc_ring_pop(data->backlog);
+		/* new senders see a non empty backlog and queue behind it meanwhile */
+		k_spin_unlock(&data->tx_lock, key);
+		stm32_ipcc_mailbox_tx_done(dev, id);
+		key = k_spin_lock(&data->tx_lock);
+	}
+	if (!stm32_ipcc_ring_empty(data->backlog)) {
+		stm32_ipcc_mailbox_wait_free(dev);
 	}
+	k_spin_unlock(&data->tx_lock, key);
+
+	k_sem_give(&data->tx_free);
 }
 
-static void stm32_ipcc_mailbox_tx_isr(const struct device *dev)
+static void stm32_ipcc_mailbox_deliver(void *ctx, uint32_t id, uint8_t *msg, uint16_t len)
 {
+	const struct device *dev = ctx;
 	struct stm32_ipcc_mbx_data *data = DEV_DATA(dev);
+
+	ARG_UNUSED(len);
+
+	if (data->callback && id < data->num_ch) {
+		data->callback(dev, data->user_data, id, msg);
+	}
+}
+
+static void stm32_ipcc_mailbox_rx(const struct device *dev, uint32_t mask)
+{
 	const struct stm32_ipcc_mailbox_config *cfg = DEV_CFG(dev);
-	uint32_t mask, i;
+
+	if (!(mask & BIT(IPCC_RING_DOORBELL_CH))) {
+		return;
+	}
+	LOG_DBG("%s doorbell", __func__);
+
+	/* acknowledge first, a message written during the drain rings again */
+	IPCC_ClearFlag_CHx(cfg->ipcc, IPCC_RING_DOORBELL_CH);
+	if (stm32_ipcc_ring_ready(cfg->rx_ring)) {
+		/* the whole batch is delivered in one interrupt */
+		stm32_ipcc_ring_drain(cfg->rx_ring, stm32_ipcc_mailbox_deliver, (void *)dev);
+	}
+}
+
+#ifndef CONFIG_CPU_CORTEX_M0PLUS
+static void stm32_ipcc_mailbox_rx_isr(const struct device *dev)
+{
+	const struct stm32_ipcc_mailbox_config *cfg = DEV_CFG(dev);
+	uint32_t mask;
+
+	mask = (~IPCC_ReadReg(cfg->ipcc, MR)) & IPCC_ALL_MR_RXO_CH_MASK;
+	mask &= IPCC_ReadOtherInstReg_SR(cfg->ipcc) & IPCC_ALL_SR_CH_MASK;
+
+	stm32_ipcc_mailbox_rx(dev, mask);
+}
+
+static void stm32_ipcc_mailbox_tx_isr(const struct device *dev)
+{
+	const struct stm32_ipcc_mailbox_config *cfg = DEV_CFG(dev);
+	uint32_t mask;
 
 	mask = (~IPCC_ReadReg(cfg->ipcc, MR)) & IPCC_ALL_MR_TXF_CH_MASK;
 	mask = mask >> IPCC_C1MR_CH1FM_Pos;
 
-	mask &= IPCC_ReadReg_SR(cfg->ipcc) & IPCC_ALL_SR_CH_MASK;
+	/* a channel is free once the other core cleared its flag */
+	mask &= ~IPCC_ReadReg_SR(cfg->ipcc) & IPCC_ALL_SR_CH_MASK;
 
-	for (i = 0; i < data->num_ch; i++) {
-		if (!((1 << i) & mask)) {
-			continue;
-		}
-		LOG_DBG("%s channel = %x", __func__, i);
-		/* mask the channel Free interrupt */
-		IPCC_DisableTransmitChannel(cfg->ipcc, i);
-	}
+	stm32_ipcc_mailbox_tx(dev, mask);
 }
 #else /* CONFIG_CPU_CORTEX_M0PLUS */
 static void stm32_ipcc_mailbox_rx_tx_isr(const struct device *dev)
 {
-	struct stm32_ipcc_mbx_data *data = DEV_DATA(dev);
 	const struct stm32_ipcc_mailbox_config *cfg = DEV_CFG(dev);
-	unsigned int value = 0;
-	uint32_t mask, i;
+	uint32_t mask;
 
 	mask = (~IPCC_ReadReg(cfg->ipcc, MR)) & IPCC_ALL_MR_RXO_CH_MASK;
 	mask &= IPCC_ReadOtherInstReg_SR(cfg->ipcc) & IPCC_ALL_SR_CH_MASK;
 
-	for (i = 0; i < data->num_ch; i++) {
-		if (!((1 << i) & mask)) {
-			continue;
-		}
-		LOG_DBG("%s channel = %x\r\n", __func__, i);
-		/* mask the channel Free interrupt  */
-		IPCC_DisableReceiveChannel(cfg->ipcc, i);
-
-		if (data->callback) {
-			/* Only one MAILBOX, id is unused and set to 0 */
-			data->callback(dev, data->user_data, i, &value);
-		}
-		/* clear status to acknoledge message reception */
-		IPCC_ClearFlag_CHx(cfg->ipcc, i);
-		IPCC_EnableReceiveChannel(cfg->ipcc, i);
-	}
+	stm32_ipcc_mailbox_rx(dev, mask);
 
 	mask = (~IPCC_ReadReg(cfg->ipcc, MR)) & IPCC_ALL_MR_TXF_CH_MASK;
 
 	mask = mask >> IPCC_C2MR_CH1FM_Pos;
 
-	mask &= IPCC_ReadReg_SR(cfg->ipcc) & IPCC_ALL_SR_CH_MASK;
+	/* a channel is free once the other core cleared its flag */
+	mask &= ~IPCC_ReadReg_SR(cfg->ipcc) & IPCC_ALL_SR_CH_MASK;
 
-	for (i = 0; i < data->num_ch; i++) {
-		if (!((1 << i) & mask)) {
-			continue;
-		}
-		LOG_DBG("%s channel = %x\r\n", __func__, i);
-		/* mask the channel Free interrupt */
-		IPCC_DisableTransmitChannel(cfg->ipcc, i);
-	}
+	stm32_ipcc_mailbox_tx(dev, mask);
 }
 #endif /* CONFIG_CPU_CORTEX_M0PLUS */
 
@@ -200,14 +294,18 @@ static int stm32_ipcc_mailbox_ipm_send(const struct device *dev, int wait,
 {
 	struct stm32_ipcc_mbx_data *data = dev->data;
 	const struct stm32_ipcc_mailbox_config *cfg = DEV_CFG(dev);
-
-	ARG_UNUSED(wait);
+	k_spinlock_key_t key;
+	uint32_t next;
+	int ret;
 
 	assert(buff);
 	assert(size > 0);
 
-	/* No data transmition, only doorbell */
-	if (size > cfg->buff_size) {
+	if (!stm32_ipcc_ring_ready(cfg->tx_ring)) {
+		return -EAGAIN;
+	}
+
+	if (size > stm32_ipcc_ring_max_len(cfg->tx_ring)) {
 		LOG_ERR("invalid buffer size (%d)", size);
 		return -EMSGSIZE;
 	}
@@ -219,26 +317,89 @@ static int stm32_ipcc_mailbox_ipm_send(const struct device *dev, int wait,
 
 	LOG_DBG("Send msg on channel %d", id);
 
-	/* Check that the channel is free (otherwise wait) */
-	if (IPCC_IsActiveFlag_CHx(cfg->ipcc, id)) {
-		LOG_DBG("Waiting for channel to be freed");
-		while (IPCC_IsActiveFlag_CHx(cfg->ipcc, id)) {
+	/*
+	 * A sender that may sleep waits for ring space up to the timeout, any
+	 * other one leaves the message in the backlog for the tx free interrupt.
+	 */
+	bool block = (wait != 0) && !k_is_in_isr();
+	uint32_t since = k_cycle_get_32();
+	uint32_t deadline = k_uptime_get_32() + CONFIG_IPM_STM32_IPCC2_TX_TIMEOUT_MS;
+
+	for (;;) {
+		key = k_spin_lock(&data->tx_lock);
+		/* the backlog goes first to keep the messages in order */
+		if (stm32_ipcc_ring_empty(data->backlog) &&
+		    stm32_ipcc_mailbox_push(dev, id, buff, (uint16_t)size, since)) {
+			k_spin_unlock(&data->tx_lock, key);
+			stm32_ipcc_mailbox_tx_done(dev, id);
+			return 0;
+		}
+
+		if (!block) {
+			uint8_t *msg = stm32_ipcc_ring_reserve(
+				data->backlog, id, (uint16_t)(size + sizeof(since)), &next);
+
+			if (msg == NULL) {
+				data->stats[id].dropped++;
+				ret = -ENOBUFS;
+			} else {
+				memcpy(msg, &since, sizeof(since));
+				memcpy(msg + sizeof(since), buff, size);
+				stm32_ipcc_ring_commit(data->backlog, next);
+				data->stats[id].queued++;
+				ret = 0;
+			}
+			stm32_ipcc_mailbox_wait_free(dev);
+			k_spin_unlock(&data->tx_lock, key);
+			return ret;
 		}
-	}
 
-	if (buff && size > 0) {
-		memcpy(cfg->buffer, buff, size);
+		k_sem_reset(&data->tx_free);
+		stm32_ipcc_mailbox_wait_free(dev);
+		k_spin_unlock(&data->tx_lock, key);
+
+		int32_t left = (int32_t)(deadline - k_uptime_get_32());
+
+		if (left <= 0 || k_sem_take(&data->tx_free, K_MSEC(left)) != 0) {
+			key = k_spin_lock(&data->tx_lock);
+			data->stats[id].dropped++;
+			k_spin_unlock(&data->tx_lock, key);
+			LOG_DBG("tx ring full");
+			return -EBUSY;
+		}
 	}
+}
+
+void ipm_stm32_ipcc2_register_tx_done(const struct device *dev, ipm_stm32_ipcc2_tx_done_t cb,
+				      void *user_data)
+{
+	struct stm32_ipcc_mbx_data *data = DEV_DATA(dev);
+	k_spinlock_key_t key = k_spin_lock(&data->tx_lock);
 
-	IPCC_EnableTransmitChannel(cfg->ipcc, id);
-	IPCC_SetFlag_CHx(cfg->ipcc, id);
+	data->tx_done = cb;
+	data->tx_done_user_data = user_data;
+	k_spin_unlock(&data->tx_lock, key);
+}
 
+int ipm_stm32_ipcc2_get_stats(const struct device *dev, uint32_t id,
+			      struct ipm_stm32_ipcc2_stats *stats)
+{
+	struct stm32_ipcc_mbx_data *data = DEV_DATA(dev);
+	k_spinlock_key_t key;
+
+	if (id >= data->num_ch) {
+		return -EINVAL;
+	}
+
+	key = k_spin_lock(&data->tx_lock);
+	*stats = data->stats[id];
+	k_spin_unlock(&data->tx_lock, key);
 	return 0;
 }
 
 static int stm32_ipcc_mailbox_ipm_max_data_size_get(const struct device *dev)
 {
-	return DEV_CFG(dev)->buff_size;
+	return stm32_ipcc_ring_max_len(DEV_CFG(dev)->tx_ring);
 }
 
 static uint32_t stm32_ipcc_mailbox_ipm_max_id_val_get(const struct device *dev)
@@ -304,7 +465,17 @@ static int stm32_ipcc_mailbox_init(const struct device *dev)
 	IPCC_DisableIT_RXO(cfg->ipcc);
 
 	/* FIXME: */
-	data->num_ch = 6;
+	data->num_ch = IPCC_CH_COUNT;
+
+	data->backlog = (struct stm32_ipcc_ring *)stm32_ipcc_backlog;
+	stm32_ipcc_ring_init(data->backlog, sizeof(stm32_ipcc_backlog));
+	k_sem_init(&data->tx_free, 0, 1);
+
+#if (CONFIG_IPM_STM32_IPCC2_PROCID == 1)
+	/* CPU1 owns the shared memory and sets both rings up before CPU2 boots */
+	stm32_ipcc_ring_init(cfg->tx_ring, cfg->tx_ring_size);
+	stm32_ipcc_ring_init(cfg->rx_ring, cfg->rx_ring_size);
+#endif
 
 	for (i = 0; i < data->num_ch; i++) {
 		/* Clear RX status */
@@ -335,8 +506,10 @@ static const struct stm32_ipcc_mailbox_config stm32_ipcc_mailbox_0_config = {
 	.ipcc = (IPCC_TypeDef *)DT_INST_REG_ADDR(0),
 	.pclken = { .bus = DT_INST_CLOCKS_CELL(0, bus),
 		    .enr = DT_INST_CLOCKS_CELL(0, bits) },
-	.buffer = (void *)DT_INST_PROP_BY_IDX(0, buffer, 0),
-	.buff_size = DT_INST_PROP_BY_IDX(0, buffer, 1)
+	.tx_ring = (struct stm32_ipcc_ring *)DT_INST_PROP_BY_IDX(0, tx_ring, 0),
+	.tx_ring_size = DT_INST_PROP_BY_IDX(0, tx_ring, 1),
+	.rx_ring = (struct stm32_ipcc_ring *)DT_INST_PROP_BY_IDX(0, rx_ring, 0),
+	.rx_ring_size = DT_INST_PROP_BY_IDX(0, rx_ring, 1)
 };
 
 DEVICE_DT_INST_DEFINE(0, &stm32_ipcc_mailbox_init, NULL, &stm32_IPCC_data,
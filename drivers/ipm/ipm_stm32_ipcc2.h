@@ -0,0 +1,73 @@
+/**
+ * Copyright (c) 2021 Skyarm Technologies
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef ZEPHYR_DRIVERS_IPM_IPM_STM32_IPCC2_H_
+#define ZEPHYR_DRIVERS_IPM_IPM_STM32_IPCC2_H_
+
+#include <device.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Per channel transmit counters
+ */
+struct ipm_stm32_ipcc2_stats {
+	/* messages written to the shared ring */
+	uint32_t sent;
+	/* messages that waited in the backlog for ring space */
+	uint32_t queued;
+	/* messages lost, backlog full or blocking wait timed out */
+	uint32_t dropped;
+	/* longest time a message waited for ring space, in cycles */
+	uint32_t max_wait_cycles;
+};
+
+/**
+ * @brief Called once a message has been written to the shared ring.
+ *
+ * The callback runs without the driver lock held and may call ipm_send()
+ * again, a message sent from it goes behind the ones still in the backlog.
+ *
+ * @warning  May run in the IPCC tx interrupt.
+ */
+typedef void (*ipm_stm32_ipcc2_tx_done_t)(const struct device *dev, void *user_data, uint32_t id);
+
+/*
+ * Backlog limit: a sender that can't block (wait == 0 or interrupt context)
+ * leaves its message in a backlog of CONFIG_IPM_STM32_IPCC2_BACKLOG_SIZE bytes
+ * while the shared ring is full. Each entry carries a 4 byte header and a
+ * 4 byte timestamp, and an entry must fit without wrapping, so only messages
+ * up to CONFIG_IPM_STM32_IPCC2_BACKLOG_SIZE / 2 - 8 bytes are sure to be
+ * queued. Larger ones are queued only when the free space happens to be
+ * contiguous, otherwise ipm_send() returns -ENOBUFS; raise the backlog size
+ * or send them with a non-zero wait.
+ */
+
+/**
+ * @brief Register the transmit completion callback
+ * @param [in] dev ipcc mailbox device
+ * @param [in] cb completion callback, NULL to remove it
+ * @param [in] user_data passed back to the callback
+ */
+void ipm_stm32_ipcc2_register_tx_done(const struct device *dev, ipm_stm32_ipcc2_tx_done_t cb,
+				      void *user_data);
+
+/**
+ * @brief Get the transmit counters of a channel
+ * @param [in] dev ipcc mailbox device
+ * @param [in] id channel id
+ * @param [out] stats counters
+ * @retval 0 on success, -EINVAL for an invalid channel.
+ */
+int ipm_stm32_ipcc2_get_stats(const struct device *dev, uint32_t id,
+			      struct ipm_stm32_ipcc2_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ZEPHYR_DRIVERS_IPM_IPM_STM32_IPCC2_H_ */
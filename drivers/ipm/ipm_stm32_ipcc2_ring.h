@@ -0,0 +1,230 @@
+/**
+ * Copyright (c) 2021 Skyarm Technologies
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef ZEPHYR_DRIVERS_IPM_IPM_STM32_IPCC2_RING_H_
+#define ZEPHYR_DRIVERS_IPM_IPM_STM32_IPCC2_RING_H_
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Single producer, single consumer ring of variable length messages living
+ * in the SRAM shared by the two cores, one ring per direction. Only the
+ * producer writes head and only the consumer writes tail, so no lock is
+ * shared between the cores. Records are 4 bytes aligned and never straddle
+ * the end of data[], a wrap record sends the consumer back to offset 0.
+ */
+
+#ifndef IPCC_RING_BARRIER
+/* Orders the data accesses against the index accesses of the other core */
+#define IPCC_RING_BARRIER() __DMB()
+#endif
+
+#define IPCC_RING_MAGIC 0x49504352 /* "IPCR" */
+#define IPCC_RING_REC_HDR 4
+#define IPCC_RING_REC_WRAP 0xFFFF
+#define IPCC_RING_ALIGN(len) (((len) + 3U) & ~3U)
+
+struct stm32_ipcc_ring {
+	volatile uint32_t magic;
+	/* offset of the next record, written by the producer only */
+	volatile uint32_t head;
+	/* offset of the oldest record, written by the consumer only */
+	volatile uint32_t tail;
+	/* bytes of data[], a multiple of 4 */
+	uint32_t size;
+	uint8_t data[];
+};
+
+struct stm32_ipcc_ring_rec {
+	uint16_t len;
+	uint8_t id;
+	uint8_t rfu;
+};
+
+typedef void (*stm32_ipcc_ring_cb_t)(void *ctx, uint32_t id, uint8_t *data, uint16_t len);
+
+/* Run once by the core owning the shared memory, before the other core starts */
+static inline void stm32_ipcc_ring_init(struct stm32_ipcc_ring *ring, uint32_t area_size)
+{
+	ring->head = 0;
+	ring->tail = 0;
+	ring->size = (area_size - sizeof(*ring)) & ~3U;
+	IPCC_RING_BARRIER();
+	ring->magic = IPCC_RING_MAGIC;
+}
+
+static inline bool stm32_ipcc_ring_ready(const struct stm32_ipcc_ring *ring)
+{
+	return ring->magic == IPCC_RING_MAGIC;
+}
+
+/* Largest message that always fits an empty ring */
+static inline uint16_t stm32_ipcc_ring_max_len(const struct stm32_ipcc_ring *ring)
+{
+	uint32_t len = ring->size / 2 - IPCC_RING_REC_HDR;
+
+	return len > UINT16_MAX - 1 ? UINT16_MAX - 1 : (uint16_t)len;
+}
+
+static inline bool stm32_ipcc_ring_empty(const struct stm32_ipcc_ring *ring)
+{
+	return ring->head == ring->tail;
+}
+
+/**
+ * Reserve room for a message of @p len bytes, to be filled in and then
+ * published with stm32_ipcc_ring_commit().
+ *
+ * @retval the message payload, NULL when the ring is full.
+ */
+static inline uint8_t *stm32_ipcc_ring_reserve(struct stm32_ipcc_ring *ring, uint32_t id,
+					       uint16_t len, uint32_t *next)
+{
+	uint32_t need = IPCC_RING_REC_HDR + IPCC_RING_ALIGN(len);
+	uint32_t head = ring->head;
+	uint32_t tail = ring->tail;
+	uint32_t pos;
+	struct stm32_ipcc_ring_rec *rec;
+
+	if (head >= tail) {
+		/* used space is [tail, head), keep head != tail once written */
+		if (ring->size - head >= need && (head + need != ring->size || tail != 0)) {
+			pos = head;
+		} else if (tail > need) {
+			rec = (struct stm32_ipcc_ring_rec *)&ring->data[head];
+			rec->len = IPCC_RING_REC_WRAP;
+			pos = 0;
+		} else {
+			return NULL;
+		}
+	} else if (tail - head > need) {
+		/* used space is [tail, size) and [0, head) */
+		pos = head;
+	} else {
+		return NULL;
+	}
+
+	rec = (struct stm32_ipcc_ring_rec *)&ring->data[pos];
+	rec->len = len;
+	rec->id = (uint8_t)id;
+
+	*next = pos + need;
+	if (*next == ring->size) {
+		*next = 0;
+	}
+	return &ring->data[pos + IPCC_RING_REC_HDR];
+}
+
+/**
+ * Publish the message reserved last.
+ *
+ * @retval true when the consumer had already drained everything before this
+ *         message, only then does it need to be woken up.
+ */
+static inline bool stm32_ipcc_ring_commit(struct stm32_ipcc_ring *ring, uint32_t next)
+{
+	uint32_t head = ring->head;
+
+	/* publish the record, then look whether the consumer went idle before it */
+	IPCC_RING_BARRIER();
+	ring->head = next;
+	IPCC_RING_BARRIER();
+	return ring->tail == head;
+}
+
+/**
+ * Copy a message into the ring, @p doorbell tells whether the consumer must
+ * be woken up.
+ *
+ * @retval 0 on success, -ENOBUFS when the ring is full.
+ */
+static inline int stm32_ipcc_ring_write(struct stm32_ipcc_ring *ring, uint32_t id,
+					const void *buff, uint16_t len, bool *doorbell)
+{
+	uint32_t next;
+	uint8_t *data = stm32_ipcc_ring_reserve(ring, id, len, &next);
+
+	if (data == NULL) {
+		return -ENOBUFS;
+	}
+
+	memcpy(data, buff, len);
+	*doorbell = stm32_ipcc_ring_commit(ring, next);
+	return 0;
+}
+
+/**
+ * Look at the oldest message without releasing it.
+ *
+ * @retval true when a message is pending.
+ */
+static inline bool stm32_ipcc_ring_peek(struct stm32_ipcc_ring *ring, uint32_t *id,
+					uint8_t **data, uint16_t *len)
+{
+	uint32_t tail = ring->tail;
+	struct stm32_ipcc_ring_rec *rec;
+
+	if (ring->head == tail) {
+		return false;
+	}
+
+	IPCC_RING_BARRIER();
+	rec = (struct stm32_ipcc_ring_rec *)&ring->data[tail];
+	if (rec->len == IPCC_RING_REC_WRAP) {
+		/* the head is known to be past the wrap, skip it and look at offset 0 */
+		ring->tail = 0;
+		rec = (struct stm32_ipcc_ring_rec *)&ring->data[0];
+	}
+
+	*id = rec->id;
+	*data = (uint8_t *)rec + IPCC_RING_REC_HDR;
+	*len = rec->len;
+	return true;
+}
+
+/* Release the message returned by the last stm32_ipcc_ring_peek() */
+static inline void stm32_ipcc_ring_pop(struct stm32_ipcc_ring *ring)
+{
+	uint32_t tail = ring->tail;
+	struct stm32_ipcc_ring_rec *rec = (struct stm32_ipcc_ring_rec *)&ring->data[tail];
+
+	tail += IPCC_RING_REC_HDR + IPCC_RING_ALIGN(rec->len);
+	if (tail == ring->size) {
+		tail = 0;
+	}
+
+	/* release the space, then let the caller check the head again for a racing write */
+	IPCC_RING_BARRIER();
+	ring->tail = tail;
+	IPCC_RING_BARRIER();
+}
+
+/**
+ * Hand every pending message to @p cb, in order. The data pointer is only
+ * valid during the callback, the space is released as soon as it returns.
+ *
+ * @retval number of delivered messages.
+ */
+static inline int stm32_ipcc_ring_drain(struct stm32_ipcc_ring *ring, stm32_ipcc_ring_cb_t cb,
+					void *ctx)
+{
+	uint32_t id;
+	uint8_t *data;
+	uint16_t len;
+	int count = 0;
+
+	while (stm32_ipcc_ring_peek(ring, &id, &data, &len)) {
+		cb(ctx, id, data, len);
+		stm32_ipcc_ring_pop(ring);
+		count++;
+	}
+
+	return count;
+}
+
+#endif /* ZEPHYR_DRIVERS_IPM_IPM_STM32_IPCC2_RING_H_ */
@@ -13,6 +13,8 @@
 #include <sys_clock.h>
 #include <zephyr.h>
 
+#include "stm32_rtc_timer.h"
+
 /**
  * This module implements a kernel device driver for the accurate
  * and low power waking up system clock timer.
@@ -41,6 +43,10 @@
  *
  * When CONFIG_SYS_CLOCK_TICKS_PER_SEC is configured to 1024, The MCU
  * can be in STOP0, STOP1,STOP2 mode up to 48 days when in PM model.
+ *
+ * CONFIG_STM32_RTC_TIMER_LSE_TICKS counts the ticks at the LSE rate,
+ * 32768 per second, the RTC prescaler A is then 0. Timeouts get a
+ * 30.5 us resolution and the longest timeout is about 18 hours.
  **/
 
 /**
@@ -73,36 +79,70 @@
 #error "Unexpected SOC series to configure RTC_TIMER_EXTI_LINE"
 #endif
 
-#define RTC_TIMER_MINIMUM_VALUE 3
+#define RTC_TIMER_MINIMUM_VALUE STM32_RTC_TIMER_MINIMUM_TICKS
+
+/* Longest timeout, keeps the elapsed ticks below half the counter range */
+#define RTC_TIMER_MAXIMUM_VALUE INT32_MAX
 
 #define DT_DRV_COMPAT st_stm32_rtc
 
 #define RTC_TIMER_PREDIV_A \
 	((DT_INST_PROP(0, prescaler) / CONFIG_SYS_CLOCK_TICKS_PER_SEC) - 1)
 
+BUILD_ASSERT(DT_INST_PROP(0, prescaler) % CONFIG_SYS_CLOCK_TICKS_PER_SEC == 0,
+	     "RTC clock is not a multiple of CONFIG_SYS_CLOCK_TICKS_PER_SEC");
+
 static struct k_spinlock rtc_timer_lock;
 
+/* Subsecond value at the last announce */
 static volatile uint32_t rtc_timer_backup = UINT32_MAX;
 
-static inline uint32_t rtc_timer_diff(uint32_t x, uint32_t y)
+/* Subsecond value alarm A is armed at */
+static uint32_t rtc_timer_alarm_a;
+static bool rtc_timer_alarm_a_armed;
+
+/* Subsecond value at kernel tick 0 */
+static uint32_t rtc_timer_origin;
+
+#ifdef CONFIG_STM32_RTC_TIMER_ALARM_B
+static stm32_rtc_timer_alarm_callback_t rtc_timer_alarm_b_callback;
+static volatile bool rtc_timer_alarm_b_armed;
+static uint32_t rtc_timer_alarm_b_counter;
+#endif
+
+/* Ticks elapsed from subsecond value from to to, the subsecond counts down */
+static inline uint32_t rtc_timer_delta(uint32_t from, uint32_t to)
 {
-	return x >= y ? x - y : y - x;
+	return from - to;
 }
 
 static void rtc_timer_alarm_isr(const struct device *unused)
 {
 	ARG_UNUSED(unused);
 
+	/* Alarm A and alarm B share the same EXTI line and interrupt */
+	LL_EXTI_ClearFlag_0_31(RTC_TIMER_EXTI_LINE);
+
+#ifdef CONFIG_STM32_RTC_TIMER_ALARM_B
+	if (LL_RTC_IsActiveFlag_ALRB(RTC)) {
+		LL_RTC_ClearFlag_ALRB(RTC);
+		rtc_timer_alarm_b_armed = false;
+		if (rtc_timer_alarm_b_callback) {
+			rtc_timer_alarm_b_callback();
+		}
+	}
+#endif
+
 	if (LL_RTC_IsActiveFlag_ALRA(RTC) == 0) {
 		return;
 	}
 	LL_RTC_ClearFlag_ALRA(RTC);
-	LL_EXTI_ClearFlag_0_31(RTC_TIMER_EXTI_LINE);
+	rtc_timer_alarm_a_armed = false;
 
 	/* Save the current subsecond and return elapsed subseconds
 	   since last rtc_timer_alarm_isr be called */
 	uint32_t current = LL_RTC_TIME_GetSubSecond(RTC);
-	uint32_t elapsed = rtc_timer_diff(rtc_timer_backup, current);
+	uint32_t elapsed = rtc_timer_delta(rtc_timer_backup, current);
 
 	rtc_timer_backup = current;
 
@@ -113,6 +153,14 @@ static void rtc_timer_set_alarm(uint32_t ticks)
 {
 	k_spinlock_key_t key = k_spin_lock(&rtc_timer_lock);
 
+	/* Already armed at this value, skip the write protected sequence */
+	if (rtc_timer_alarm_a_armed && rtc_timer_alarm_a == ticks) {
+		k_spin_unlock(&rtc_timer_lock, key);
+		return;
+	}
+	rtc_timer_alarm_a = ticks;
+	rtc_timer_alarm_a_armed = true;
+
 	/* Disable RTC writing protection */
 	LL_RTC_DisableWriteProtection(RTC);
 
@@ -138,6 +186,81 @@ static void rtc_timer_set_alarm(uint32_t ticks)
 	k_spin_unlock(&rtc_timer_lock, key);
 }
 
+uint32_t stm32_rtc_timer_get_counter(void)
+{
+	return rtc_timer_delta(rtc_timer_origin, LL_RTC_TIME_GetSubSecond(RTC));
+}
+
+#ifdef CONFIG_STM32_RTC_TIMER_ALARM_B
+void stm32_rtc_timer_set_alarm_b(uint32_t counter,
+				 stm32_rtc_timer_alarm_callback_t callback)
+{
+	k_spinlock_key_t key = k_spin_lock(&rtc_timer_lock);
+
+	uint32_t now = stm32_rtc_timer_get_counter();
+
+	/* Keep the alarm out of the window the RTC may already have passed */
+	if ((int32_t)(counter - now) < RTC_TIMER_MINIMUM_VALUE) {
+		counter = now + RTC_TIMER_MINIMUM_VALUE;
+	}
+
+	rtc_timer_alarm_b_callback = callback;
+	rtc_timer_alarm_b_counter = counter;
+	rtc_timer_alarm_b_armed = true;
+
+	/* Disable RTC writing protection */
+	LL_RTC_DisableWriteProtection(RTC);
+
+	/* Disable alarm and IT, clear alarm flag*/
+	LL_RTC_ALMB_Disable(RTC);
+	LL_RTC_DisableIT_ALRB(RTC);
+	LL_RTC_ClearFlag_ALRB(RTC);
+
+	/* Set alarm subsecond (down-counter value) and mask */
+	RTC->ALRMBSSR = RTC_ALARMSUBSECONDBINMASK_NONE;
+	LL_RTC_ALMB_SetSubSecond(RTC, rtc_timer_origin - counter);
+
+	/* Enable alarm and interrupt again */
+	LL_RTC_ALMB_Enable(RTC);
+	LL_RTC_EnableIT_ALRB(RTC);
+
+	/* Enable RTC writing protection again */
+	LL_RTC_EnableWriteProtection(RTC);
+
+	/* Enable EXTI IT, Let me wake up from low power mode */
+	LL_EXTI_EnableIT_0_31(RTC_TIMER_EXTI_LINE);
+
+	k_spin_unlock(&rtc_timer_lock, key);
+}
+
+void stm32_rtc_timer_stop_alarm_b(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&rtc_timer_lock);
+
+	LL_RTC_DisableWriteProtection(RTC);
+	LL_RTC_ALMB_Disable(RTC);
+	LL_RTC_DisableIT_ALRB(RTC);
+	LL_RTC_ClearFlag_ALRB(RTC);
+	LL_RTC_EnableWriteProtection(RTC);
+
+	rtc_timer_alarm_b_armed = false;
+
+	k_spin_unlock(&rtc_timer_lock, key);
+}
+
+bool stm32_rtc_timer_get_alarm_b(uint32_t *counter)
+{
+	k_spinlock_key_t key = k_spin_lock(&rtc_timer_lock);
+	bool armed = rtc_timer_alarm_b_armed;
+
+	*counter = rtc_timer_alarm_b_counter;
+
+	k_spin_unlock(&rtc_timer_lock, key);
+
+	return armed;
+}
+#endif /* CONFIG_STM32_RTC_TIMER_ALARM_B */
+
 static const struct stm32_pclken rtc_clock_pclken = {
 	.enr = DT_INST_CLOCKS_CELL(0, bits), .bus = DT_INST_CLOCKS_CELL(0, bus)
 };
@@ -215,6 +338,13 @@ int sys_clock_driver_init(const struct device *dev)
 	/* Clear the alarm a flag */
 	LL_RTC_ClearFlag_ALRA(RTC);
 
+	/* The subsecond keeps running across resets when the clock source is kept */
+	rtc_timer_backup = LL_RTC_TIME_GetSubSecond(RTC);
+	rtc_timer_origin = rtc_timer_backup;
+#ifdef CONFIG_STM32_RTC_TIMER_ALARM_B
+	LL_RTC_ClearFlag_ALRB(RTC);
+#endif
+
 	IRQ_CONNECT(DT_IRQN(DT_NODELABEL(rtc)), DT_IRQ(DT_NODELABEL(rtc), priority),
 		    rtc_timer_alarm_isr, NULL, 0);
 	irq_enable(DT_IRQN(DT_NODELABEL(rtc)));
@@ -232,6 +362,10 @@ void sys_clock_set_timeout(int32_t ticks, bool idle)
 
 	k_spinlock_key_t key = k_spin_lock(&rtc_timer_lock);
 
+	if (ticks == K_TICKS_FOREVER || ticks > RTC_TIMER_MAXIMUM_VALUE) {
+		ticks = RTC_TIMER_MAXIMUM_VALUE;
+	}
+
 	uint32_t current = LL_RTC_TIME_GetSubSecond(RTC);
 	/*
 	 * The timeout can be a "negative" value, but it's an unsigned int type,
@@ -243,7 +377,7 @@ void sys_clock_set_timeout(int32_t ticks, bool idle)
 	uint32_t timeout = current - (uint32_t)ticks;
 
 	if (LL_RTC_IsActiveFlag_ALRA(RTC)) {
-		if (rtc_timer_diff(rtc_timer_backup, current) < RTC_TIMER_MINIMUM_VALUE) {
+		if (rtc_timer_delta(rtc_timer_backup, current) < RTC_TIMER_MINIMUM_VALUE) {
 			/* interrupt happens or happens soon. It's impossible to set an alarm. */
 			k_spin_unlock(&rtc_timer_lock, key);
 			return;
@@ -270,7 +404,7 @@ uint32_t sys_clock_elapsed(void)
 	/* return the difference subseconds since last rtc_timer_alarm_isr is called
 	 */
 	uint32_t current = LL_RTC_TIME_GetSubSecond(RTC);
-	uint32_t elapsed = rtc_timer_diff(rtc_timer_backup, current);
+	uint32_t elapsed = rtc_timer_delta(rtc_timer_backup, current);
 
 	k_spin_unlock(&rtc_timer_lock, key);
 
@@ -0,0 +1,75 @@
+/**
+ * Copyright (c) 2021 Skyarm Technologies
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef STM32_RTC_TIMER_H
+#define STM32_RTC_TIMER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The RTC subsecond counter runs at the system clock tick rate,
+ * see RTC_TIMER_PREDIV_A in stm32_rtc_timer.c.
+ */
+#define STM32_RTC_TIMER_TICKS_PER_SEC CONFIG_SYS_CLOCK_TICKS_PER_SEC
+
+/**
+ * The minimum distance in ticks between now and an alarm,
+ * alarms closer than this are delayed to it.
+ */
+#define STM32_RTC_TIMER_MINIMUM_TICKS 3
+
+/**
+ * @brief Callback invoked from the RTC interrupt when alarm B expires.
+ */
+typedef void (*stm32_rtc_timer_alarm_callback_t)(void);
+
+/**
+ * @brief Read the RTC counter.
+ *
+ * The counter is the subsecond down-counter taken relative to its value
+ * at kernel tick 0, so it counts up at STM32_RTC_TIMER_TICKS_PER_SEC from
+ * the driver init, matches the low 32 bits of k_uptime_ticks() and wraps
+ * at UINT32_MAX.
+ *
+ * @retval current counter value in ticks
+ */
+uint32_t stm32_rtc_timer_get_counter(void);
+
+#ifdef CONFIG_STM32_RTC_TIMER_ALARM_B
+/**
+ * @brief Program RTC alarm B.
+ *
+ * @param counter absolute counter value the alarm expires at,
+ *        see stm32_rtc_timer_get_counter().
+ * @param callback function called from the RTC interrupt on expiry.
+ */
+void stm32_rtc_timer_set_alarm_b(uint32_t counter,
+				 stm32_rtc_timer_alarm_callback_t callback);
+
+/**
+ * @brief Disable RTC alarm B.
+ */
+void stm32_rtc_timer_stop_alarm_b(void);
+
+/**
+ * @brief Get the expiry of RTC alarm B.
+ *
+ * @param counter set to the absolute counter value the alarm expires at.
+ *
+ * @retval true when the alarm is armed, false when it is stopped or
+ *         has already expired.
+ */
+bool stm32_rtc_timer_get_alarm_b(uint32_t *counter);
+#endif /* CONFIG_STM32_RTC_TIMER_ALARM_B */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* STM32_RTC_TIMER_H */
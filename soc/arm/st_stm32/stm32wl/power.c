@@ -13,11 +13,184 @@
 #include <stm32wlxx_ll_cortex.h>
 #include <stm32wlxx_ll_pwr.h>
 #include <stm32wlxx_ll_rcc.h>
-#include <clock_control/clock_stm32_ll_common.h>
+#include <errno.h>
+
+#ifdef CONFIG_STM32_RTC_TIMER_ALARM_B
+#include <stm32_rtc_timer.h>
+#endif
+#include "stm32wl_power.h"
 
 #include <logging/log.h>
 LOG_MODULE_DECLARE(soc, CONFIG_SOC_LOG_LEVEL);
 
+/* Clocks running before entering STOP, the wake-up leaves only MSI on */
+static struct {
+	uint32_t sysclk;
+	bool hse;
+	bool hsi;
+	bool pll;
+} pm_rcc;
+
+static struct stm32wl_pm_stats pm_stats[STM32WL_PM_SUBSTATE_COUNT];
+static uint32_t pm_entry_cycles;
+
+static void stm32wl_rcc_save(void)
+{
+	pm_rcc.sysclk = LL_RCC_GetSysClkSource();
+	pm_rcc.hse = LL_RCC_HSE_IsReady();
+	pm_rcc.hsi = LL_RCC_HSI_IsReady();
+	pm_rcc.pll = LL_RCC_PLL_IsReady();
+}
+
+/*
+ * The RCC configuration, prescalers and PLL settings are kept in STOP
+ * modes, only the oscillators are stopped and the system clock switched
+ * to MSI. Restart what was running instead of initializing the whole
+ * clock tree again.
+ */
+static void stm32wl_rcc_restore(void)
+{
+	if (LL_RCC_GetSysClkSource() == pm_rcc.sysclk) {
+		/* STOP mode not entered because of a pending IT, or running on MSI */
+		return;
+	}
+
+	if (pm_rcc.hse && !LL_RCC_HSE_IsReady()) {
+		LL_RCC_HSE_Enable();
+		while (LL_RCC_HSE_IsReady() == 0) {
+		}
+	}
+
+	if (pm_rcc.hsi && !LL_RCC_HSI_IsReady()) {
+		LL_RCC_HSI_Enable();
+		while (LL_RCC_HSI_IsReady() == 0) {
+		}
+	}
+
+	if (pm_rcc.pll && !LL_RCC_PLL_IsReady()) {
+		LL_RCC_PLL_Enable();
+		while (LL_RCC_PLL_IsReady() == 0) {
+		}
+	}
+
+	/* the SWS status bits are the SW bits shifted */
+	LL_RCC_SetSysClkSource(pm_rcc.sysclk >> RCC_CFGR_SWS_Pos);
+	while (LL_RCC_GetSysClkSource() != pm_rcc.sysclk) {
+	}
+}
+
+/* The STOP flag of this core is cleared before entry, set once STOP was reached */
+static bool stm32wl_pm_stop_entered(void)
+{
+#ifndef CONFIG_CPU_CORTEX_M0PLUS
+	return LL_PWR_IsActiveFlag_C1STOP() != 0;
+#else
+	return LL_PWR_IsActiveFlag_C2STOP() != 0;
+#endif
+}
+
+#ifdef CONFIG_CPU_CORTEX_M_HAS_DWT
+/*
+ * Restore the clocks and return the time it took in us. k_cycle_get_32()
+ * only has RTC tick resolution, far coarser than a restore, so the core
+ * cycles are counted instead. They run at the MSI wake-up clock up to the
+ * final switch back to the saved system clock.
+ */
+static uint32_t stm32wl_pm_restore_clocks(void)
+{
+	uint32_t msi = __LL_RCC_CALC_MSI_FREQ(LL_RCC_MSI_IsEnabledRangeSelect(),
+					      (LL_RCC_MSI_IsEnabledRangeSelect() == 1U) ?
+					      LL_RCC_MSI_GetRange() :
+					      LL_RCC_MSI_GetRangeAfterStandby());
+	uint32_t start = DWT->CYCCNT;
+
+	stm32wl_rcc_restore();
+
+	return (uint32_t)(((uint64_t)(DWT->CYCCNT - start) * USEC_PER_SEC + msi - 1) / msi);
+}
+#else
+/* No cycle counter on this core, the exit latency is not measured */
+static uint32_t stm32wl_pm_restore_clocks(void)
+{
+	stm32wl_rcc_restore();
+	return 0;
+}
+#endif /* CONFIG_CPU_CORTEX_M_HAS_DWT */
+
+#ifdef CONFIG_STM32WL_PM_POLICY
+static const struct pm_state_info pm_states[] =
+	PM_STATE_INFO_DT_ITEMS_LIST(DT_NODELABEL(cpu0));
+
+/* Time left before the next kernel timeout or LoRaMAC timer, in us */
+static uint32_t stm32wl_pm_next_deadline_us(int32_t ticks)
+{
+	uint64_t us = UINT32_MAX;
+
+	if (ticks != K_TICKS_FOREVER) {
+		us = k_ticks_to_us_floor64(ticks);
+	}
+
+#ifdef CONFIG_STM32_RTC_TIMER_ALARM_B
+	uint32_t counter;
+
+	if (stm32_rtc_timer_get_alarm_b(&counter)) {
+		int32_t left = counter - stm32_rtc_timer_get_counter();
+
+		us = MIN(us, left > 0 ? k_ticks_to_us_floor64(left) : 0);
+	}
+#endif
+
+	return MIN(us, UINT32_MAX);
+}
+
+/*
+ * Pick the deepest STOP mode whose residency, wake-up and clock restore
+ * time fit before the next deadline. The LoRaMAC timers run on RTC alarm
+ * B, unknown to the kernel, and already expire early by the radio wake-up
+ * time for the receive windows.
+ */
+struct pm_state_info pm_policy_next_state(int32_t ticks)
+{
+	uint32_t deadline = stm32wl_pm_next_deadline_us(ticks);
+	uint32_t exit_latency;
+	int i;
+
+	for (i = ARRAY_SIZE(pm_states) - 1; i >= 0; i--) {
+		if (!pm_constraint_get(pm_states[i].state)) {
+			continue;
+		}
+
+		exit_latency = pm_states[i].exit_latency_us;
+		if (pm_states[i].substate_id >= 1 &&
+		    pm_states[i].substate_id <= STM32WL_PM_SUBSTATE_COUNT) {
+			exit_latency += pm_stats[pm_states[i].substate_id - 1].max_exit_latency_us;
+		}
+
+		if (deadline == UINT32_MAX ||
+		    deadline >= pm_states[i].min_residency_us + exit_latency) {
+			return pm_states[i];
+		}
+	}
+
+	return (struct pm_state_info){ .state = PM_STATE_ACTIVE };
+}
+#endif /* CONFIG_STM32WL_PM_POLICY */
+
+int stm32wl_pm_get_stats(uint8_t substate_id, struct stm32wl_pm_stats *stats)
+{
+	unsigned int key;
+
+	if (substate_id < 1 || substate_id > STM32WL_PM_SUBSTATE_COUNT) {
+		return -EINVAL;
+	}
+
+	key = irq_lock();
+	*stats = pm_stats[substate_id - 1];
+	irq_unlock(key);
+
+	return 0;
+}
+
 /* Invoke Low Power/System Off specific Tasks */
 void pm_power_state_set(struct pm_state_info info)
 {
@@ -26,10 +199,15 @@ void pm_power_state_set(struct pm_state_info info)
 		return;
 	}
 
+	stm32wl_rcc_save();
+	pm_entry_cycles = k_cycle_get_32();
+
 	switch (info.substate_id) {
 	case 1: /* this corresponds to the STOP0 mode: */
 #ifndef		CONFIG_CPU_CORTEX_M0PLUS
 		LL_PWR_ClearFlag_C1STOP_C1STB();
+#else
+		LL_PWR_ClearFlag_C2STOP_C2STB();
 #endif
 		/* ensure MSI is the wake-up system clock */
 		LL_RCC_SetClkAfterWakeFromStop(LL_RCC_STOP_WAKEUPCLOCK_MSI);
@@ -42,6 +220,8 @@ void pm_power_state_set(struct pm_state_info info)
 	case 2: /* this corresponds to the STOP1 mode: */
 #ifndef         CONFIG_CPU_CORTEX_M0PLUS
                 LL_PWR_ClearFlag_C1STOP_C1STB();
+#else
+		LL_PWR_ClearFlag_C2STOP_C2STB();
 #endif
 		/* ensure MSI is the wake-up system clock */
 		LL_RCC_SetClkAfterWakeFromStop(LL_RCC_STOP_WAKEUPCLOCK_MSI);
@@ -54,6 +234,8 @@ void pm_power_state_set(struct pm_state_info info)
 	case 3: /* this corresponds to the STOP2 mode: */
 #ifndef         CONFIG_CPU_CORTEX_M0PLUS
                 LL_PWR_ClearFlag_C1STOP_C1STB();
+#else
+		LL_PWR_ClearFlag_C2STOP_C2STB();
 #endif
 		/* ensure MSI is the wake-up system clock */
 		LL_RCC_SetClkAfterWakeFromStop(LL_RCC_STOP_WAKEUPCLOCK_MSI);
@@ -75,6 +257,10 @@ void pm_power_state_set(struct pm_state_info info)
 /* Handle SOC specific activity after Low Power Mode Exit */
 void pm_power_state_exit_post_ops(struct pm_state_info info)
 {
+	struct stm32wl_pm_stats *stats;
+	uint32_t wakeup, latency;
+	bool stopped;
+
 	if (info.state != PM_STATE_SUSPEND_TO_IDLE) {
 		LOG_DBG("Unsupported power state %u", info.state);
 	} else {
@@ -92,14 +278,21 @@ void pm_power_state_exit_post_ops(struct pm_state_info info)
 				info.substate_id);
 			break;
 		}
-		if (LL_RCC_GetSysClkSource() == LL_RCC_SYS_CLKSOURCE_STATUS_PLL) {
-			LOG_DBG("MCU did not enter stop mode beacuse NVIC had a pending IT");
-		} else {
-			/* need to restore the clock */
-			stm32_clock_control_init(NULL);
-			LL_PWR_EnableBkUpAccess();
-  			while (LL_PWR_IsEnabledBkUpAccess() == 0) {
-  			}
+
+		wakeup = k_cycle_get_32();
+		stopped = stm32wl_pm_stop_entered();
+		latency = stm32wl_pm_restore_clocks();
+
+		/* a pending interrupt makes the core skip STOP, that is no entry */
+		if (stopped && info.substate_id >= 1 &&
+		    info.substate_id <= STM32WL_PM_SUBSTATE_COUNT) {
+			stats = &pm_stats[info.substate_id - 1];
+			stats->count++;
+			stats->residency_us += k_cyc_to_us_floor32(wakeup - pm_entry_cycles);
+			stats->exit_latency_us = latency;
+			if (stats->exit_latency_us > stats->max_exit_latency_us) {
+				stats->max_exit_latency_us = stats->exit_latency_us;
+			}
 		}
 	}
 
@@ -120,6 +313,11 @@ static int stm32_power_init(const struct device *dev)
 	/* Enable the Debug Module during STOP mode */
 	LL_DBGMCU_EnableDBGStopMode();
 #endif /* CONFIG_DEBUG */
+#ifdef CONFIG_CPU_CORTEX_M_HAS_DWT
+	/* cycle counter timing the clock restore */
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif /* CONFIG_CPU_CORTEX_M_HAS_DWT */
 	LOG_DBG("Initialize STM32 Power success");
 	return 0;
 }
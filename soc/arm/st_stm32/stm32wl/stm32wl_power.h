@@ -0,0 +1,46 @@
+/**
+ * Copyright (c) 2021 Skyarm Technologies
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _STM32WL_POWER_H_
+#define _STM32WL_POWER_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* STOP0, STOP1 and STOP2, power state substates 1 to 3 */
+#define STM32WL_PM_SUBSTATE_COUNT 3
+
+/**
+ * @brief Per STOP mode counters
+ */
+struct stm32wl_pm_stats {
+	/* times the core really entered the state */
+	uint32_t count;
+	/* time spent in the state */
+	uint64_t residency_us;
+	/* time to restore the clocks after the last wake-up, 0 on cores
+	 * without a cycle counter
+	 */
+	uint32_t exit_latency_us;
+	/* longest time to restore the clocks */
+	uint32_t max_exit_latency_us;
+};
+
+/**
+ * @brief Get the counters of a STOP mode
+ * @param [in] substate_id power state substate, 1 for STOP0 to 3 for STOP2
+ * @param [out] stats counters
+ * @retval 0 on success, -EINVAL for an invalid substate.
+ */
+int stm32wl_pm_get_stats(uint8_t substate_id, struct stm32wl_pm_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _STM32WL_POWER_H_ */